@@ -0,0 +1,133 @@
+// 统计单个文件热路径（PID提取、JSON解析、标签列表、备注格式化）的堆分配次数
+// 解析结果会进入元数据缓存，其字符串与标签列表始终分配在全局堆上
+#include "arena.h"
+#include "pixiv_api.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace {
+
+std::atomic<size_t> g_alloc_count{0};
+std::atomic<size_t> g_alloc_bytes{0};
+
+std::string make_sample_body() {
+    std::string body = R"({"error":false,"message":"","body":{"illustId":"97847210",)"
+                       R"("illustTitle":"夏の終わりの帰り道","userId":"1234567","userName":"作者名前@お仕事募集中",)"
+                       R"("bookmarkCount":12345,"illustComment":"コメントです。<br />詳細は<a href=\"https://example.com/page\" target=\"_blank\">こちら</a><br />よろしくお願いします",)"
+                       R"("tags":{"tags":[)";
+    for (int i = 0; i < 16; ++i) {
+        if (i > 0) body += ",";
+        body += R"({"tag":"オリジナルタグ番号)" + std::to_string(i) + R"(","locked":true)";
+        if (i % 2 == 0) {
+            body += R"(,"translation":{"en":"original tag number )" + std::to_string(i) + R"("})";
+        }
+        body += "}";
+    }
+    body += "]}}}";
+    return body;
+}
+
+void process_file(const pixiv2billfish::PixivAPI& api, const std::string& filename, const std::string& body,
+                  const std::string& artwork_url) {
+    using namespace pixiv2billfish;
+    
+    thread_local std::string origin_buffer;
+    
+    auto pid = PixivAPI::extract_pid(filename);
+    auto illust = PixivAPI::parse_illust(body, *pid);
+    std::string_view origin = PixivAPI::format_pid_url(artwork_url, *pid, origin_buffer);
+    std::pmr::string note = api.format_note(illust->info, *pid, origin);
+    
+    if (illust->tags.empty() || note.empty() || origin.empty()) {
+        std::abort();
+    }
+}
+
+template<typename F>
+void run(const char* label, size_t iterations, F&& f) {
+    size_t count_before = g_alloc_count.load();
+    size_t bytes_before = g_alloc_bytes.load();
+    auto start = std::chrono::steady_clock::now();
+    
+    for (size_t i = 0; i < iterations; ++i) {
+        f();
+    }
+    
+    auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+    std::printf("%-12s %10.1f mallocs/file %10.1f bytes/file %8.2f us/file\n", label,
+                double(g_alloc_count.load() - count_before) / iterations,
+                double(g_alloc_bytes.load() - bytes_before) / iterations,
+                elapsed.count() / iterations);
+}
+
+} // namespace
+
+void* operator new(size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    // 基准中的分配对齐不超过 max_align_t，malloc 即可满足
+    if (static_cast<size_t>(alignment) > alignof(std::max_align_t)) {
+        throw std::bad_alloc();
+    }
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char* argv[]) {
+    size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000;
+    const std::string body = make_sample_body();
+    const std::string filename = "97847210_p0.png";
+    const pixiv2billfish::Config config;
+    const pixiv2billfish::PixivAPI api(config);
+    const std::string& artwork_url = config.pixiv_artwork_url;
+    
+    // 预热：正则编译、线程内存池初始缓冲区等一次性分配
+    {
+        pixiv2billfish::ArenaScope arena;
+        process_file(api, filename, body, artwork_url);
+    }
+    process_file(api, filename, body, artwork_url);
+    
+    run("heap", iterations, [&] {
+        process_file(api, filename, body, artwork_url);
+    });
+    
+    run("arena", iterations, [&] {
+        pixiv2billfish::ArenaScope arena;
+        process_file(api, filename, body, artwork_url);
+    });
+    
+    return 0;
+}
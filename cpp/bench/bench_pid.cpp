@@ -0,0 +1,89 @@
+// 对比逐个 extract_pid 与批量 extract_pids 的PID提取速度，并校验两者结果一致
+#include "pixiv_api.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 生成接近真实图库的文件名：多页作品、带标题的文件、非Pixiv文件、快捷方式等
+std::vector<std::string> make_names(size_t count) {
+    static const char* const extensions[] = {
+        ".png", ".jpg", ".gif", ".webp", ".zip", ".jpg.lnk", ".png.lnk", ".psd", ".mp4"
+    };
+    
+    std::mt19937_64 rng(42);
+    std::vector<std::string> names;
+    names.reserve(count);
+    
+    for (size_t i = 0; i < count; ++i) {
+        std::string pid = std::to_string(60000000 + rng() % 60000000);
+        const char* ext = extensions[rng() % (sizeof(extensions) / sizeof(extensions[0]))];
+        
+        switch (rng() % 6) {
+        case 0:
+        case 1:
+            names.push_back(pid + "_p" + std::to_string(rng() % 40) + ext);
+            break;
+        case 2:
+            names.push_back(pid + "-" + "夏の終わりの帰り道" + ext);
+            break;
+        case 3:
+            names.push_back(pid + ext);
+            break;
+        case 4:
+            names.push_back("IMG_" + pid + ext);
+            break;
+        default:
+            names.push_back("illust_" + pid + "_by-artist" + ext);
+            break;
+        }
+    }
+    
+    return names;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using namespace pixiv2billfish;
+    
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    auto names = make_names(count);
+    
+    std::vector<std::string_view> views(names.begin(), names.end());
+    std::vector<uint64_t> scalar(count);
+    std::vector<uint64_t> batch(count);
+    
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        scalar[i] = PixivAPI::extract_pid(names[i]).value_or(0);
+    }
+    auto scalar_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    
+    start = std::chrono::steady_clock::now();
+    PixivAPI::extract_pids(views.data(), views.size(), batch.data());
+    auto batch_time = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start);
+    
+    size_t mismatches = 0;
+    size_t matched = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (scalar[i] != batch[i]) {
+            if (++mismatches <= 5) {
+                std::fprintf(stderr, "mismatch: %s (%llu vs %llu)\n", names[i].c_str(),
+                             static_cast<unsigned long long>(scalar[i]),
+                             static_cast<unsigned long long>(batch[i]));
+            }
+        }
+        matched += batch[i] != 0;
+    }
+    
+    std::printf("files: %zu, with pid: %zu\n", count, matched);
+    std::printf("%-12s %8.1f ns/file\n", "extract_pid", scalar_time.count() / count);
+    std::printf("%-12s %8.1f ns/file\n", "extract_pids", batch_time.count() / count);
+    
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+// 规模基准：生成 1万 / 10万 / 100万 文件的合成图库，测量启动阶段（读取文件列表、提取PID、加载缓存）
+// 的耗时，以及离线应用覆盖全部作品的抓取包时的稳态写入吞吐（不经过网络）
+#include "config.h"
+#include "database.h"
+#include "library_generator.h"
+#include "processor.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool run_size(size_t file_count, bool v3, const std::filesystem::path& dir) {
+    using namespace pixiv2billfish;
+    
+    std::string db_path = (dir / ("scale_" + std::to_string(file_count) + ".db")).string();
+    
+    tools::LibraryOptions options;
+    options.file_count = file_count;
+    options.v3 = v3;
+    options.tag_count = std::max<size_t>(file_count / 20, 1000);
+    options.bundle_path = db_path + ".ndjson";
+    
+    auto start = Clock::now();
+    tools::LibraryStats library;
+    if (!tools::generate_library(db_path, options, library)) {
+        return false;
+    }
+    std::printf("\n== %zu 个文件 (%s): %zu 个PID, %zu 个标签, %zu 条关联, %zu 条备注 (生成 %.0f ms)\n",
+                library.files, v3 ? "3.0" : "2.x", library.pids, library.tags, library.tag_joins,
+                library.notes, elapsed_ms(start));
+    
+    Database db(db_path);
+    if (!db.open()) {
+        return false;
+    }
+    
+    // 启动阶段：与 Processor::initialize / select_files 相同的读取步骤
+    auto total = Clock::now();
+    
+    start = Clock::now();
+    int64_t count = db.get_file_count();
+    FileIndex files = db.get_files(0, static_cast<int>(count));
+    double files_ms = elapsed_ms(start);
+    
+    start = Clock::now();
+    files.classify();
+    double classify_ms = elapsed_ms(start);
+    
+    start = Clock::now();
+    auto tags = db.get_tags(v3);
+    double tags_ms = elapsed_ms(start);
+    
+    start = Clock::now();
+    auto tagged = db.get_tagged_file_ids();
+    double tagged_ms = elapsed_ms(start);
+    
+    start = Clock::now();
+    auto noted = db.get_noted_file_ids();
+    double noted_ms = elapsed_ms(start);
+    
+    std::printf("启动  读取文件 %8.1f ms  提取PID %7.1f ms  标签表 %7.1f ms  已有关联 %7.1f ms  已有备注 %7.1f ms  合计 %8.1f ms\n",
+                files_ms, classify_ms, tags_ms, tagged_ms, noted_ms, elapsed_ms(total));
+    std::printf("      文件索引 %.1f 字节/文件, %zu 个标签, %zu 个已有标签的文件, %zu 个已有备注的文件\n",
+                files.bytes_per_row(), tags.size(), tagged.size(), noted.size());
+    
+    // 稳态写入：离线应用抓取包（标签、关联与备注经批量缓冲写入）
+    Config config;
+    config.db_path = db_path;
+    Processor processor(config, db);
+    
+    start = Clock::now();
+    if (!processor.apply({options.bundle_path})) {
+        return false;
+    }
+    double apply_ms = elapsed_ms(start);
+    std::printf("写入  应用抓取包 %8.1f ms  (%.0f 文件/秒)\n", apply_ms, library.files / (apply_ms / 1000.0));
+    
+    db.close();
+    std::filesystem::remove(db_path);
+    std::filesystem::remove(options.bundle_path);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    bool v3 = false;
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::vector<size_t> sizes;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--v3") {
+            v3 = true;
+        } else if (arg == "--dir" && i + 1 < argc) {
+            dir = argv[++i];
+        } else {
+            sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+        }
+    }
+    if (sizes.empty()) {
+        sizes = {10000, 100000, 1000000};
+    }
+    
+    // 只保留警告，避免处理日志影响计时
+    spdlog::set_level(spdlog::level::warn);
+    
+    for (size_t size : sizes) {
+        if (!run_size(size, v3, dir)) {
+            std::fprintf(stderr, "规模 %zu 运行失败\n", size);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+namespace pixiv2billfish {
+
+// 写缓冲区的自适应提交规模：根据实测的每行提交耗时，把单次提交控制在目标耗时附近
+// （SSD 上批量自动变大，数据库被 Billfish 锁住导致提交变慢时自动变小）；
+// 另外最早一条未写入的数据等待超过 max_lag 时也会触发写入。
+// 不加锁，由调用方在缓冲区的锁内使用
+class AdaptiveBatch {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    AdaptiveBatch(size_t initial_size, std::chrono::milliseconds target_commit,
+                  std::chrono::milliseconds max_lag);
+    
+    // 向缓冲区添加数据后调用（记录最早一条未写入数据的时间）
+    void mark_pending();
+    
+    // 缓冲区中有 pending 条数据时是否应该写入
+    bool should_flush(size_t pending) const;
+    
+    // 一次写入结束：rows 行耗时 elapsed。成功时清除等待计时并据此调整批量大小；
+    // 失败时数据仍在缓冲区，保留最早一条的等待计时，失败的耗时也不计入每行耗时
+    void record_commit(size_t rows, Clock::duration elapsed, bool success);
+    
+    // 运行中修改参数（重新加载配置）：批量大小从新的初始值重新开始调整
+    void reconfigure(size_t initial_size, std::chrono::milliseconds target_commit,
+                     std::chrono::milliseconds max_lag);
+    
+    // 当前的批量大小
+    size_t limit() const { return limit_; }
+
+private:
+    static constexpr size_t kMinSize = 8;
+    static constexpr size_t kMaxSize = 20000;
+    
+    size_t limit_;
+    double row_cost_us_ = 0;  // 每行提交耗时（微秒，指数平滑）
+    std::chrono::microseconds target_commit_;
+    std::chrono::milliseconds max_lag_;
+    Clock::time_point first_pending_{};
+    bool has_pending_ = false;
+};
+
+} // namespace pixiv2billfish
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <type_traits>
+
+namespace pixiv2billfish {
+
+// 线程内的单调内存池：处理单个文件期间的临时对象（URL、JSON DOM、标签列表、备注等）
+// 都从这里分配，文件处理结束后整体释放，避免大量零碎的 malloc/free
+class TaskArena {
+public:
+    // 当前线程的内存池
+    static TaskArena& local();
+    
+    std::pmr::memory_resource* resource() { return &pool_; }
+    
+    // 释放本次任务的全部分配，保留初始缓冲区供下次使用
+    void reset() { pool_.release(); }
+
+private:
+    static constexpr size_t kInitialSize = 64 * 1024;
+    
+    TaskArena();
+    
+    std::unique_ptr<std::byte[]> initial_buffer_;
+    std::pmr::monotonic_buffer_resource pool_;
+};
+
+// 作用域内把当前线程的临时分配切换到 TaskArena，离开时重置内存池
+// 作用域内分配的对象不得带出作用域
+class ArenaScope {
+public:
+    ArenaScope();
+    ~ArenaScope();
+    
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+private:
+    std::pmr::memory_resource* previous_;
+};
+
+// 当前线程的临时内存资源（不在 ArenaScope 内时为全局堆）
+std::pmr::memory_resource* current_resource();
+
+// 记住构造时 current_resource() 的分配器，供只接受分配器模板的容器（如 nlohmann::basic_json）使用。
+// basic_json 的节点在释放时才临时构造分配器，所以释放时的当前资源必须与分配时相同：
+// 这样的对象不得带出（或带入）构造它的 ArenaScope，调试构建中由断言检查
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+    
+    ArenaAllocator() noexcept : resource_(current_resource()) {}
+    
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : resource_(other.resource()) {}
+    
+    T* allocate(size_t n) {
+        return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+    
+    void deallocate(T* p, size_t n) noexcept {
+        assert(resource_ == current_resource() && "ArenaAllocator: 对象在分配它的 ArenaScope 之外释放");
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+    
+    std::pmr::memory_resource* resource() const noexcept { return resource_; }
+    
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const noexcept { return resource_ == other.resource(); }
+    
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const noexcept { return resource_ != other.resource(); }
+
+private:
+    std::pmr::memory_resource* resource_;
+};
+
+} // namespace pixiv2billfish
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "pixiv_api.h"
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace pixiv2billfish {
+
+// 元数据包中的一条记录（NDJSON，每行一条）：
+//   {"file_id":123,"pid":456,"tags":["a","b"]}                分片暂存文件，按文件
+//   {"file_id":123,"pid":456,"note":"...","origin":"..."}
+//   {"pid":456,"tags":["a","b"],"note":"...","origin":"..."}  抓取包，按作品，应用时映射到同PID的全部文件
+// pid 也接受字符串形式
+struct BundleRecord {
+    int64_t file_id = 0;  // 0 表示按 pid 匹配文件
+    Pid pid = 0;
+    
+    bool has_tags = false;
+    TagList tags;
+    
+    bool has_note = false;
+    std::string note;
+    std::string origin;
+};
+
+// 元数据包写入器（线程安全，按行追加）
+class BundleWriter {
+public:
+    explicit BundleWriter(const std::string& path);
+    ~BundleWriter();
+    
+    BundleWriter(const BundleWriter&) = delete;
+    BundleWriter& operator=(const BundleWriter&) = delete;
+    
+    // 打开文件（覆盖已有内容）
+    bool open();
+    
+    // 写入标签结果
+    void write_tags(int64_t file_id, Pid pid, const TagList& tags);
+    
+    // 写入备注结果
+    void write_note(int64_t file_id, Pid pid, std::string_view note, std::string_view origin);
+    
+    // 写入按作品的完整结果（标签与备注）
+    void write_illust(Pid pid, const TagList& tags, std::string_view note, std::string_view origin);
+    
+    // 刷新并关闭
+    bool close();
+    
+    // 已写入的记录数
+    size_t record_count() const;
+    
+    const std::string& path() const { return path_; }
+
+private:
+    std::string path_;
+    std::ofstream file_;
+    mutable std::mutex mutex_;
+    size_t record_count_ = 0;
+    
+    void write_line(const std::string& line);
+};
+
+// 元数据包读取器
+class BundleReader {
+public:
+    explicit BundleReader(const std::string& path);
+    
+    // 打开文件
+    bool open();
+    
+    // 读取下一条记录，文件结束时返回false；格式错误的行会被跳过并计数
+    bool next(BundleRecord& record);
+    
+    // 被跳过的错误行数
+    size_t error_count() const { return error_count_; }
+
+private:
+    std::string path_;
+    std::ifstream file_;
+    std::string line_;
+    size_t line_number_ = 0;
+    size_t error_count_ = 0;
+};
+
+} // namespace pixiv2billfish
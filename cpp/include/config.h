@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <map>
+#include <vector>
 
 namespace pixiv2billfish {
 
@@ -9,6 +11,9 @@ struct Config {
     // 数据库配置
     std::string db_path = "billfish.db";
     
+    // 多图库模式：同时处理多个数据库，共用网络请求、限速与元数据缓存（非空时忽略 db_path）
+    std::vector<std::string> db_paths;
+    
     // 代理配置
     bool use_proxies = false;
     std::string http_proxy;
@@ -23,6 +28,19 @@ struct Config {
     int start_file_num = 0;
     int end_file_num = 0;
     
+    // 增量同步：只处理上次运行之后新增的文件（按 bf_file.id 高水位）
+    bool incremental = false;
+    std::string state_file;  // 为空时使用 "<db_path>.sync.json"
+    
+    // 监视模式：常驻并轮询数据库变化，只处理新增文件
+    bool watch = false;
+    int watch_interval_ms = 2000;
+    
+    // 分片模式（命令行 --shard i/n）：只处理按 PID 哈希落在第 i 片的文件，结果写入分片暂存文件
+    int shard_index = 0;
+    int shard_count = 1;
+    std::string staging_file;  // 为空时使用 "<db_path>.shard-<i>-of-<n>.ndjson"
+    
     // 线程配置
     int tag_thread_count = 8;
     int note_thread_count = 8;
@@ -31,15 +49,34 @@ struct Config {
     int request_timeout = 5;
     int retry_count = 5;
     int request_delay_ms = 100; // 请求间延迟，避免频繁请求
+    double max_requests_per_second = 0; // 全局请求速率上限（所有线程、所有图库共用，0=不限）
+    int metadata_cache_size = 10000;    // 作品元数据缓存条数
+    bool batch_user_fetch = false;      // 标签按作者批量预取（批量接口没有标签翻译，不用于备注）
+    int progress_interval_sec = 5;      // 处理期间输出进度行的间隔（秒，0=不输出）
+    std::string note_template;          // 备注模板（为空时使用 NoteTemplate::kDefault）
     
-    // 批量写入配置
+    // 数据库连接
+    int read_connections = 0;           // 只读连接池大小（0=读写共用一个连接）
+    bool wal = false;                   // 写连接使用 WAL 日志模式（会持久改变数据库文件的日志模式）
+    
+    // 批量写入配置（初始批量大小，运行中按实测提交耗时自适应调整）
     int batch_size_tag = 20;
     int batch_size_tag_join = 50;
     int batch_size_note = 10;
+    int target_commit_ms = 100;         // 单次提交的目标耗时（毫秒，0=固定使用初始批量大小）
+    int max_write_lag_ms = 2000;        // 结果在缓冲区中最长等待时间（毫秒，0=只按批量大小写入）
+    
+    // 运行中重新加载配置：检查配置文件修改时间的间隔（毫秒，0=不检查，只响应 SIGHUP）
+    int config_reload_interval_ms = 1000;
+    
+    // 运行追踪：非空时把各线程的处理区间导出为 Chrome trace JSON（chrome://tracing、ui.perfetto.dev）
+    std::string trace_file;
+    int trace_buffer_events = 65536;    // 每个线程保留的最近事件数（超出后覆盖最早的事件）
     
     // Pixiv API配置
     std::string pixiv_api_url = "https://www.pixiv.net/ajax/illust/";
     std::string pixiv_artwork_url = "https://www.pixiv.net/artworks/";
+    std::string pixiv_user_api_url = "https://www.pixiv.net/ajax/user/";
     
     // HTTP Headers
     std::map<std::string, std::string> headers = {
@@ -55,6 +92,27 @@ struct Config {
     
     // 保存配置
     bool save_to_file(const std::string& filename) const;
+    
+    // 增量同步状态文件路径
+    std::string sync_state_path() const;
+    
+    // 是否为分片模式
+    bool sharded() const { return shard_count > 1; }
+    
+    // 分片暂存文件路径
+    std::string staging_path() const;
+};
+
+// 增量同步状态
+struct SyncState {
+    int64_t last_file_id = 0;  // 已处理完成的最大 bf_file.id
+    std::map<int64_t, int> retry_attempts;  // 高水位之后处理失败、等待重试的文件ID -> 已失败次数
+    
+    // 加载状态
+    bool load_from_file(const std::string& filename);
+    
+    // 保存状态
+    bool save_to_file(const std::string& filename) const;
 };
 
 } // namespace pixiv2billfish
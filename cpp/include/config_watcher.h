@@ -0,0 +1,86 @@
+#pragma once
+
+#include "config.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace pixiv2billfish {
+
+// 运行中重新加载配置：配置文件的修改时间变化（按 config_reload_interval_ms 轮询）或收到 SIGHUP 时
+// 重新读取配置文件，把新旧配置交给订阅者。订阅者只取其中可以在运行中调整的参数
+// （线程数、限速、请求间隔、重试、超时、代理、请求头与批量参数），进行中的任务不受影响
+class ConfigWatcher {
+public:
+    using Listener = std::function<void(const Config& previous, const Config& updated)>;
+    
+    // 订阅句柄，析构时取消订阅（会等待正在执行的回调结束）
+    class Subscription {
+    public:
+        Subscription() = default;
+        Subscription(ConfigWatcher* watcher, size_t id) : watcher_(watcher), id_(id) {}
+        Subscription(Subscription&& other) noexcept;
+        Subscription& operator=(Subscription&& other) noexcept;
+        ~Subscription();
+        
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+    
+    private:
+        ConfigWatcher* watcher_ = nullptr;
+        size_t id_ = 0;
+    };
+    
+    // initial 为启动时加载的配置，命令行参数等不在配置文件中的字段在重新加载时保留
+    ConfigWatcher(std::string path, const Config& initial);
+    ~ConfigWatcher();
+    
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+    
+    // 启动后台检查线程
+    void start();
+    
+    // 停止后台检查线程
+    void stop();
+    
+    Subscription subscribe(Listener listener);
+    
+    // 请求重新加载（只设置标志，可在信号处理函数中调用）
+    static void request_reload();
+
+private:
+    std::string path_;
+    Config current_;
+    std::filesystem::file_time_type last_write_time_{};
+    
+    std::mutex listeners_mutex_;
+    std::map<size_t, Listener> listeners_;
+    size_t next_id_ = 1;
+    
+    std::mutex stop_mutex_;
+    std::condition_variable stop_condition_;
+    bool stop_ = false;
+    std::thread thread_;
+    
+    static std::atomic<bool> reload_requested_;
+    
+    void unsubscribe(size_t id);
+    
+    // 后台线程：定期检查修改时间与重新加载标志
+    void watch_loop();
+    
+    // 配置文件的修改时间（读取失败时返回空值）
+    std::filesystem::file_time_type read_write_time() const;
+    
+    // 重新读取配置文件并通知订阅者
+    void reload();
+};
+
+} // namespace pixiv2billfish
@@ -1,21 +1,21 @@
 #pragma once
 
+#include "file_index.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <optional>
 #include <mutex>
+#include <utility>
 
 namespace pixiv2billfish {
 
-struct FileRecord {
-    int64_t id;
-    std::string name;
-};
-
+// 标签名指向 TagTable 中驻留的字符串，不持有拷贝
 struct TagRecord {
     int64_t id;
-    std::string name;
+    std::string_view name;
+    int64_t parent_id = 0;  // 父标签ID（仅V3数据库；0 表示顶层标签）
 };
 
 struct TagJoinFileRecord {
@@ -23,9 +23,24 @@ struct TagJoinFileRecord {
     int64_t tag_id;
 };
 
+// 一批新标签的写入结果
+struct TagInsertResult {
+    bool ok = false;          // 整批已写入
+    bool retryable = false;   // 未写入的原因是数据库被锁等暂时性错误，原批次可稍后重试
+    
+    // 暂定ID -> 实际ID：同名标签已存在时为已有标签的ID，暂定ID已被占用时为新分配的ID
+    std::vector<std::pair<int64_t, int64_t>> remapped;
+};
+
 struct NoteRecord {
     int64_t file_id;
     std::string note;
+    std::string origin;  // 作品页URL，写入 origin 列
+};
+
+struct DatabaseOptions {
+    int read_connections = 0;  // 只读连接池大小（0=读写共用写连接，按调用顺序串行）
+    bool wal = false;          // 写连接使用 WAL 日志模式，读连接与写事务互不阻塞
 };
 
 class Database {
@@ -37,8 +52,17 @@ public:
     Database(const Database&) = delete;
     Database& operator=(const Database&) = delete;
     
-    // 打开数据库连接
-    bool open();
+    // 打开数据库连接（一个写连接，以及可选的只读连接池）
+    bool open(const DatabaseOptions& options = {});
+    
+    // 以只读方式打开（用于并发查询，不影响写连接）
+    bool open_read_only();
+    
+    // 是否启用了只读连接池（查询与写入可以同时进行）
+    bool has_read_pool() const;
+    
+    // 数据库文件路径
+    const std::string& path() const;
     
     // 关闭数据库连接
     void close();
@@ -47,7 +71,13 @@ public:
     bool is_version_3();
     
     // 获取文件列表
-    std::vector<FileRecord> get_files(int start, int limit);
+    FileIndex get_files(int start, int limit);
+    
+    // 获取ID大于 after_id 的文件（按ID升序）
+    FileIndex get_files_after(int64_t after_id);
+    
+    // 获取数据库变化计数（其他连接提交写入后递增）
+    int64_t get_data_version();
     
     // 获取文件总数
     int64_t get_file_count();
@@ -55,20 +85,21 @@ public:
     // 获取所有标签
     std::vector<TagRecord> get_tags(bool is_v3);
     
-    // 获取文件-标签关联
-    std::vector<TagJoinFileRecord> get_tag_join_files();
+    // 获取已有标签关联的文件ID（去重）
+    std::vector<int64_t> get_tagged_file_ids();
     
-    // 获取备注
-    std::vector<NoteRecord> get_notes();
+    // 获取已有非空备注的文件ID
+    std::vector<int64_t> get_noted_file_ids();
     
-    // 批量插入标签
-    bool insert_tags(const std::vector<TagRecord>& tags, bool is_v3);
+    // 批量插入标签：ID由调用方暂定，与已有标签同名的改用已有标签，ID被占用的在事务内重新分配，
+    // 两者都通过 remapped 返回
+    TagInsertResult insert_tags(const std::vector<TagRecord>& tags, bool is_v3);
     
-    // 批量插入文件-标签关联
-    bool insert_tag_join_files(const std::vector<TagJoinFileRecord>& records);
+    // 批量插入文件-标签关联（跳过已存在的关联；skip_tagged_files 时跳过已有任何标签的文件）
+    bool insert_tag_join_files(const std::vector<TagJoinFileRecord>& records, bool skip_tagged_files = false);
     
-    // 批量插入备注
-    bool insert_notes(const std::vector<NoteRecord>& notes);
+    // 批量写入备注（已有记录只更新备注与来源；skip_noted_files 时不覆盖已有非空备注）
+    bool insert_notes(const std::vector<NoteRecord>& notes, bool skip_noted_files = false);
     
     // 获取Artist父标签ID
     std::optional<int64_t> get_artist_tag_id();
@@ -76,10 +107,7 @@ public:
     // 创建Artist父标签
     bool create_artist_tag();
     
-    // 获取Artist子标签
-    std::vector<TagRecord> get_artist_subtags();
-    
-    // 更新Artist标签
+    // 把旧版本写入的 "Artist:xxx" 标签改名为 "xxx" 并挂到Artist父标签下
     bool update_artist_tags(const std::vector<TagRecord>& tags, int64_t parent_id);
     
     // 开始事务
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pixiv2billfish {
+
+// 作品ID（0 表示无）
+using Pid = uint64_t;
+
+// 列式文件索引：ID、文件名与PID各占一列，文件名共用一块连续内存并按偏移定位。
+// 任务按行号引用文件，不再逐个拷贝文件名
+class FileIndex {
+public:
+    using Row = uint32_t;
+    
+    FileIndex();
+    
+    // 预留行数与文件名总字节数
+    void reserve(size_t rows, size_t name_bytes);
+    
+    // 追加一行
+    void add(int64_t id, std::string_view name);
+    
+    size_t size() const { return ids_.size(); }
+    bool empty() const { return ids_.empty(); }
+    
+    int64_t id(Row row) const { return ids_[row]; }
+    
+    std::string_view name(Row row) const {
+        return std::string_view(names_.data() + name_offsets_[row], name_offsets_[row + 1] - name_offsets_[row]);
+    }
+    
+    // 解析后的PID（需先调用 classify，无法提取时为0）
+    Pid pid(Row row) const { return pids_[row]; }
+    
+    const std::vector<int64_t>& ids() const { return ids_; }
+    const std::vector<Pid>& pids() const { return pids_; }
+    
+    // 批量解析全部文件名的PID列
+    void classify();
+    
+    // PID列是否已解析
+    bool classified() const { return pids_.size() == ids_.size(); }
+    
+    // 只保留 keep(row) 为 true 的行（保持顺序），PID列同步压缩
+    template<typename Predicate>
+    void retain(Predicate keep);
+    
+    // 每行平均占用的字节数（不含容器自身）
+    double bytes_per_row() const;
+
+private:
+    std::vector<int64_t> ids_;
+    std::vector<uint32_t> name_offsets_;  // size() + 1 个，第 i 行文件名为 [offsets[i], offsets[i+1])
+    std::string names_;
+    std::vector<Pid> pids_;
+};
+
+template<typename Predicate>
+void FileIndex::retain(Predicate keep) {
+    const bool has_pids = classified();
+    
+    std::string names;
+    names.reserve(names_.size());
+    
+    size_t kept = 0;
+    for (Row row = 0; row < ids_.size(); ++row) {
+        if (!keep(row)) {
+            continue;
+        }
+        
+        std::string_view row_name = name(row);
+        ids_[kept] = ids_[row];
+        if (has_pids) {
+            pids_[kept] = pids_[row];
+        }
+        name_offsets_[kept] = static_cast<uint32_t>(names.size());
+        names.append(row_name);
+        kept++;
+    }
+    
+    ids_.resize(kept);
+    if (has_pids) {
+        pids_.resize(kept);
+    }
+    name_offsets_.resize(kept + 1);
+    name_offsets_[kept] = static_cast<uint32_t>(names.size());
+    names_ = std::move(names);
+}
+
+} // namespace pixiv2billfish
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <map>
 #include <memory>
 #include <optional>
@@ -14,6 +15,7 @@ struct HttpResponse {
     bool success;
 };
 
+// 设置方法可以在其他线程请求进行中调用（运行中重新加载配置），对之后发出的请求生效
 class HttpClient {
 public:
     HttpClient();
@@ -29,12 +31,15 @@ public:
     void set_headers(const std::map<std::string, std::string>& headers);
     
     // GET请求
-    std::optional<HttpResponse> get(const std::string& url, int retry_count = 5);
+    std::optional<HttpResponse> get(std::string_view url, int retry_count = 5);
     
     // POST请求
-    std::optional<HttpResponse> post(const std::string& url, 
+    std::optional<HttpResponse> post(std::string_view url, 
                                      const std::string& data,
                                      int retry_count = 5);
+    
+    // 归还响应体缓冲区，供当前线程的下一次请求复用
+    static void recycle_buffer(std::string&& buffer);
 
 private:
     class Impl;
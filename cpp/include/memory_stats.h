@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+
+namespace pixiv2billfish {
+
+// 内存统计的流水线阶段
+enum class MemoryStage : uint8_t {
+    kOther,
+    kHttp,       // 网络请求与响应体
+    kJson,       // 接口响应解析
+    kTags,       // 标签解析为ID、写入缓冲区
+    kDatabase,   // 数据库查询与写入
+    kCount
+};
+
+#ifdef PIXIV2BILLFISH_MEMORY_STATS
+
+// 内存统计构建（-DPIXIV2BILLFISH_MEMORY_STATS=ON）：替换全局 operator new/delete，
+// 按当前线程所处的阶段统计分配次数、字节数与未释放字节数（释放计入分配时的阶段），
+// 并在运行期间采样进程 RSS。C++ 分配与 curl 的分配按阶段计数；SQLite 直接使用 malloc，
+// 只能单独报告其总用量。普通构建中以下接口均为空操作
+class MemoryStageScope {
+public:
+    explicit MemoryStageScope(MemoryStage stage);
+    ~MemoryStageScope();
+    
+    MemoryStageScope(const MemoryStageScope&) = delete;
+    MemoryStageScope& operator=(const MemoryStageScope&) = delete;
+
+private:
+    MemoryStage previous_;
+};
+
+class MemoryStats {
+public:
+    // 采样当前 RSS（进度输出时调用），记录采样到的最大值
+    static void sample();
+    
+    // 用计数的分配函数完成 curl 全局初始化（curl_global_init_mem），curl 内部的分配也按阶段统计；
+    // 返回是否已初始化，普通构建返回 false，由调用方自行调用 curl_global_init
+    static bool init_curl();
+    
+    // 输出各阶段的分配统计、SQLite 自身的内存用量与 RSS / 峰值 RSS
+    static void report();
+};
+
+#else
+
+class MemoryStageScope {
+public:
+    explicit MemoryStageScope(MemoryStage) {}
+};
+
+class MemoryStats {
+public:
+    static void sample() {}
+    static bool init_curl() { return false; }
+    static void report() {}
+};
+
+#endif
+
+} // namespace pixiv2billfish
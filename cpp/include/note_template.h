@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pixiv2billfish {
+
+// 备注模板（配置项 note_template），启动时编译一次为"字面量 / 字段 / 条件跳转"指令序列，
+// 之后每条备注按指令顺序一次写入预先分配好长度的缓冲区。语法：
+//   {title} {artist} {uid} {bookmark} {comment} {pid} {origin}  字段
+//   {?comment}...{/comment}  字段非空时输出中间部分
+//   {!comment}...{/comment}  字段为空时输出中间部分
+//   {{ }}                    字面量花括号
+class NoteTemplate {
+public:
+    enum Field : uint8_t {
+        kTitle,
+        kArtist,
+        kUid,
+        kBookmark,
+        kComment,
+        kPid,
+        kOrigin,
+        kFieldCount
+    };
+    
+    using Values = std::array<std::string_view, kFieldCount>;
+    
+    // 默认模板，与原先固定格式的备注一致
+    static constexpr std::string_view kDefault =
+        "Title:{title}\r\nArtist:{artist}\r\nUID:{uid}\r\nBookmark:{bookmark}\r\n"
+        "{?comment}Comment:\r\n{comment}{/comment}{!comment}No Comment\r\n{/comment}"
+        "\r\nOrigin:{origin}";
+    
+    // 编译模板，语法错误时返回空并写入 error
+    static std::optional<NoteTemplate> compile(std::string_view source, std::string* error = nullptr);
+    
+    // 按字段值渲染
+    std::pmr::string render(const Values& values, std::pmr::memory_resource* resource) const;
+
+private:
+    enum class OpKind : uint8_t {
+        kLiteral,      // literals_[begin, begin + size)
+        kField,        // 字段 field
+        kSkipIfEmpty,  // 字段 field 为空时跳到指令 begin
+        kSkipIfSet     // 字段 field 非空时跳到指令 begin
+    };
+    
+    struct Op {
+        OpKind kind;
+        Field field;
+        uint32_t begin;   // 字面量偏移，或跳转目标
+        uint32_t size;
+    };
+    
+    std::string literals_;   // 全部字面量连续存放
+    std::vector<Op> ops_;
+    
+    NoteTemplate() = default;
+};
+
+} // namespace pixiv2billfish
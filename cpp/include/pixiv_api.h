@@ -2,19 +2,55 @@
 
 #include "http_client.h"
 #include "config.h"
-#include <vector>
-#include <string>
+#include "file_index.h"
+#include "note_template.h"
+#include "rate_limiter.h"
+#include "tag_table.h"
+#include <atomic>
+#include <list>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace pixiv2billfish {
 
+// 单个作品的标签列表（已驻留的标签句柄）
+using TagList = std::vector<TagHandle>;
+
 struct IllustInfo {
-    std::string title;
-    std::string artist;
-    std::string user_id;
-    int bookmark_count;
-    std::string comment;
-    std::vector<std::string> tags;
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    
+    std::pmr::string title;
+    std::pmr::string artist;
+    std::pmr::string user_id;
+    int bookmark_count = 0;
+    std::pmr::string comment;
+    
+    explicit IllustInfo(const allocator_type& alloc = {})
+        : title(alloc), artist(alloc), user_id(alloc), comment(alloc) {}
+    
+    IllustInfo(IllustInfo&& other, const allocator_type& alloc)
+        : title(std::move(other.title), alloc), artist(std::move(other.artist), alloc),
+          user_id(std::move(other.user_id), alloc), bookmark_count(other.bookmark_count),
+          comment(std::move(other.comment), alloc) {}
+    
+    IllustInfo(IllustInfo&&) = default;
+};
+
+// 一次插画接口请求得到的元数据，标签与备注共用，并可在多个图库之间共享
+struct IllustData {
+    TagList tags;
+    IllustInfo info;
+    
+    // 来自作者批量接口的部分数据：没有标签翻译、简介与收藏数，只用于标签
+    bool partial = false;
 };
 
 class PixivAPI {
@@ -22,27 +58,97 @@ public:
     explicit PixivAPI(const Config& config);
     ~PixivAPI() = default;
     
-    // 获取插画标签
-    std::optional<std::vector<std::string>> get_tags(const std::string& pid);
+    // 获取插画元数据（带缓存，同一PID的并发请求只发出一次），失败返回空指针
+    // allow_partial 为 true 时可以返回作者批量接口预取的部分数据
+    std::shared_ptr<const IllustData> get_illust(Pid pid, bool allow_partial = false);
+    
+    // 运行中应用新配置的网络参数（限速、请求间隔、重试、超时、请求头与代理），之后发出的请求生效
+    void apply_runtime_config(const Config& previous, const Config& updated);
+    
+    // 作者批量预取（batch_user_fetch）：登记图库中需要的PID。
+    // 之后每遇到一个新作者，就一次性预取该作者在候选中的其余作品
+    void add_batch_candidates(const std::vector<Pid>& pids);
+    
+    // 解析插画接口返回的标签与详细信息
+    static std::optional<IllustData> parse_illust(std::string_view body, Pid pid);
+    
+    // 解析作者批量接口（profile/illusts）返回的作品，写入 pid -> 部分数据
+    static bool parse_user_illusts(std::string_view body,
+                                   std::unordered_map<Pid, std::shared_ptr<const IllustData>>& works);
     
-    // 获取插画详细信息（用于备注）
-    std::optional<IllustInfo> get_illust_info(const std::string& pid);
+    // 从文件名提取PID（逐个扫描的参考实现），PID为0或超出 uint64 范围时视为无法提取
+    static std::optional<Pid> extract_pid(std::string_view filename);
     
-    // 从文件名提取PID
-    static std::optional<std::string> extract_pid(const std::string& filename);
+    // 批量提取PID（扩展名按整数比较，数字串一次解析），语义与 extract_pid 相同，无法提取时写入 0
+    static void extract_pids(const std::string_view* names, size_t count, Pid* pids);
     
-    // 格式化备注信息
-    static std::string format_note(const IllustInfo& info);
+    // 把 prefix 与十进制PID写入 buffer（复用其容量，不产生新分配），返回指向 buffer 的视图
+    static std::string_view format_pid_url(std::string_view prefix, Pid pid, std::string& buffer);
+    
+    // 按配置的备注模板格式化备注（origin 为作品页URL，同时作为单独的列写入）
+    std::pmr::string format_note(const IllustInfo& info, Pid pid, std::string_view origin) const;
+    
+    // 元数据缓存命中次数
+    size_t cache_hits() const { return cache_hits_.load(); }
+    
+    // 实际发出的插画请求次数
+    size_t request_count() const { return request_count_.load(); }
+    
+    // 作者批量接口请求次数与预取的作品数
+    size_t batch_request_count() const { return batch_request_count_.load(); }
+    size_t batch_prefetch_count() const { return batch_prefetch_count_.load(); }
 
 private:
+    using IllustFuture = std::shared_future<std::shared_ptr<const IllustData>>;
+    
+    struct CacheEntry {
+        IllustFuture future;
+        std::list<Pid>::iterator order;  // 在 cache_order_ 中的位置
+    };
+    
     HttpClient http_client_;
     const Config& config_;
+    RateLimiter rate_limiter_;
+    NoteTemplate note_template_;
+    
+    // 可在运行中调整的请求参数
+    std::atomic<int> request_delay_ms_;
+    std::atomic<int> retry_count_;
+    
+    // PID -> 元数据（含进行中的请求），按插入顺序淘汰
+    std::mutex cache_mutex_;
+    std::unordered_map<Pid, CacheEntry> cache_;
+    std::list<Pid> cache_order_;
+    std::atomic<size_t> cache_hits_{0};
+    std::atomic<size_t> request_count_{0};
+    
+    // 作者批量预取（受 cache_mutex_ 保护）
+    std::unordered_set<Pid> batch_candidates_;
+    std::unordered_set<std::string> batch_users_;  // 已展开的作者
+    std::atomic<size_t> batch_request_count_{0};
+    std::atomic<size_t> batch_prefetch_count_{0};
+    
+    // 写入缓存条目并按插入顺序淘汰（调用方持有 cache_mutex_）
+    void insert_cache_locked(Pid pid, IllustFuture future);
+    
+    // 移除缓存条目（调用方持有 cache_mutex_）
+    void erase_cache_locked(Pid pid);
+    
+    // 请求并解析插画元数据（不经过缓存）
+    std::shared_ptr<const IllustData> fetch_illust(Pid pid);
+    
+    // 展开作者：查询其全部作品，按批预取候选中尚未缓存的作品
+    void prefetch_user_works(const std::string& user_id);
+    
+    // 请求作者接口（先延迟与限速），失败返回空
+    std::optional<HttpResponse> fetch_user_endpoint(std::string_view url);
+    
     
     // 处理艺术家名称
-    static std::string process_artist_name(const std::string& artist);
+    static std::string_view process_artist_name(std::string_view artist);
     
     // 清理HTML标签
-    static std::string clean_html(const std::string& html);
+    static std::pmr::string clean_html(std::string_view html);
 };
 
 } // namespace pixiv2billfish
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "adaptive_batch.h"
+#include "bundle.h"
 #include "config.h"
 #include "database.h"
 #include "pixiv_api.h"
 #include "thread_pool.h"
 #include <atomic>
+#include <functional>
+#include <future>
 #include <memory>
+#include <string_view>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -17,16 +22,41 @@ struct Statistics {
     std::atomic<int> fail_count{0};
     std::atomic<int> skip_count{0};
     
+    // 已有结果（成功、失败或跳过）的数量
+    int done_count() const { return success_count + fail_count + skip_count; }
+    
+    // 清零（每批开始时调用，统计只反映本批）
+    void reset();
+    
     void print(const std::string& prefix) const;
 };
 
+// 同一作品（PID）的文件组：多页作品只请求一次，结果分发给组内全部文件
+struct FileGroup {
+    Pid pid;
+    std::vector<FileIndex::Row> rows;  // 组内文件在 FileIndex 中的行号
+};
+
 class Processor {
 public:
-    Processor(const Config& config, Database& db);
+    // api 为空时自行创建；多图库模式下传入共享的 PixivAPI
+    Processor(const Config& config, Database& db, std::shared_ptr<PixivAPI> api = nullptr);
     ~Processor();
     
     // 运行处理流程
     bool run();
+    
+    // 监视模式：首轮处理后常驻，检测到新文件时只处理增量，直到 stop_flag 置位
+    bool watch(const std::atomic<bool>& stop_flag);
+    
+    // 抓取模式：只请求网络，把每个PID的标签与备注写入元数据包，不写数据库
+    bool fetch(const std::string& bundle_path);
+    
+    // 应用元数据包（分片暂存文件或抓取包）：离线一次性写入数据库（标签、关联、备注各一个事务）
+    bool apply(const std::vector<std::string>& bundle_files);
+    
+    // 运行中应用新配置的线程数与批量参数（可从其他线程调用），进行中的任务与缓冲区中的数据不受影响
+    void apply_runtime_config(const Config& previous, const Config& updated);
 
 private:
     const Config& config_;
@@ -34,58 +64,129 @@ private:
     bool is_v3_db_;
     
     // API客户端
-    std::unique_ptr<PixivAPI> pixiv_api_;
+    std::shared_ptr<PixivAPI> pixiv_api_;
     
-    // 线程池
+    // 线程池（创建与调整线程数受 pool_mutex_ 保护）
     std::unique_ptr<ThreadPool> tag_pool_;
     std::unique_ptr<ThreadPool> note_pool_;
+    std::mutex pool_mutex_;
+    int tag_thread_count_;
+    int note_thread_count_;
     
     // 缓存
-    std::unordered_map<std::string, int64_t> tag_cache_;  // tag_name -> tag_id
+    std::vector<int64_t> tag_ids_;                        // TagHandle -> tag_id（0 表示尚无）
+    int64_t next_tag_id_ = 1;                             // 下一个可用的标签ID
     std::unordered_set<int64_t> existing_file_tags_;      // file_id with tags
     std::unordered_set<int64_t> existing_file_notes_;     // file_id with notes
     
+    // Artist标签层级（仅V3数据库）：新建的作者标签直接以去掉前缀的名称挂到父标签下
+    int64_t artist_tag_id_ = 0;                           // Artist父标签ID（0 表示不维护层级）
+    std::vector<TagRecord> legacy_artist_tags_;           // 加载缓存时发现的未迁移 "Artist:xxx" 标签
+    
     // 批量写入缓冲区
     std::vector<TagRecord> pending_tags_;
     std::vector<TagJoinFileRecord> pending_tag_joins_;
     std::vector<NoteRecord> pending_notes_;
     std::mutex buffer_mutex_;
     
+    // 各缓冲区的提交规模（按实测提交耗时自适应，受 buffer_mutex_ 保护）
+    AdaptiveBatch tag_batch_;
+    AdaptiveBatch tag_join_batch_;
+    AdaptiveBatch note_batch_;
+    std::atomic<int> max_write_lag_ms_;
+    
+    // 分片模式下的暂存文件（非空时结果写入暂存文件而不是数据库）
+    std::unique_ptr<BundleWriter> staging_;
+    
     // 统计信息
     Statistics tag_stats_;
     Statistics note_stats_;
     
+    // 增量同步
+    SyncState sync_state_;
+    int64_t max_seen_file_id_ = 0;        // 已处理过的最大文件ID（监视模式据此只取新增文件）
+    std::mutex retry_mutex_;
+    std::vector<int64_t> failed_files_;   // 本批需要重试的文件（受 retry_mutex_ 保护）
+    
     // 初始化
     bool initialize();
     
     // 加载缓存数据
     void load_cache();
     
-    // 处理标签任务
-    void process_tag_task(const FileRecord& file, int index, int total);
+    // 监视模式下数据库被其他程序修改后重新读取标签表（名称与最大ID），
+    // 缓冲区中的新标签仍无法写入时不重建并返回 false
+    bool reload_tags();
+    
+    // 选择本次需要处理的文件
+    FileIndex select_files();
+    
+    // 分片模式下只保留属于本分片的文件
+    void filter_shard(FileIndex& files) const;
     
-    // 处理备注任务
-    void process_note_task(const FileRecord& file, int index, int total);
+    // 规划：按PID分组（保持首次出现的顺序），无法提取PID的文件计入失败
+    std::vector<FileGroup> plan_groups(FileIndex& files);
+    
+    // 处理一批文件：提交任务、等待完成并写入剩余缓冲区，返回缓冲区是否全部写入
+    bool process_files(FileIndex& files);
+    
+    // 等待全部任务完成，期间每隔 progress_interval_sec 秒调用一次 report 输出进度，
+    // 并按 max_write_lag_ms 定时写入积压的缓冲区
+    void wait_with_progress(std::vector<std::future<void>>& futures, const std::function<void()>& report);
+    
+    // 处理一批文件并打印统计、推进高水位，返回是否有文件需要重试
+    bool run_batch(FileIndex& files);
+    
+    // 根据本批文件推进同步高水位（增量模式下写入状态文件），累计失败文件的重试次数，
+    // 返回是否有文件需要重试
+    bool advance_sync_state(const FileIndex& files);
+    
+    // 记录因请求或写入失败需要下次重试的文件
+    void mark_retry(int64_t file_id);
+    
+    // 缓冲区中仍有未写入的记录时，把其中最小的文件ID记为需要重试
+    void mark_unflushed_retry();
+    
+    // 处理标签任务（一个PID组）
+    void process_tag_task(const FileIndex& files, const FileGroup& group, int index, int total);
+    
+    // 处理备注任务（一个PID组）
+    void process_note_task(const FileIndex& files, const FileGroup& group, int index, int total);
+    
+    // 抓取任务：请求单个PID并写入元数据包
+    void process_fetch_task(Pid pid, int index, int total, Statistics& stats);
+    
+    // 获取缓冲区锁（发生争用时把等待时间记入运行追踪）
+    std::unique_lock<std::mutex> lock_buffers();
     
     // 添加标签到缓冲区
-    void add_tags_to_buffer(int64_t file_id, const std::vector<std::string>& tags);
+    void add_tags_to_buffer(int64_t file_id, const TagList& tags);
     
     // 添加备注到缓冲区
-    void add_note_to_buffer(int64_t file_id, const std::string& note, const std::string& origin);
+    void add_note_to_buffer(int64_t file_id, std::string_view note, std::string_view origin);
     
-    // 刷新缓冲区到数据库
+    // 刷新缓冲区到数据库（force=false 时只在达到批量大小或等待超时时写入）
     bool flush_tag_buffer(bool force = false);
     bool flush_tag_join_buffer(bool force = false);
     bool flush_note_buffer(bool force = false);
     
+    // 写入缓冲区中的全部新标签（须持有缓冲区锁）
+    bool write_pending_tags();
+    
+    // 按写入结果把暂定标签ID改为实际ID（缓存与待写入的关联），实际ID为 0 表示标签已丢弃（须持有缓冲区锁）
+    void remap_tag_ids(const std::vector<std::pair<int64_t, int64_t>>& remapped);
+    
+    // 写入等待超时的缓冲区
+    void flush_overdue();
+    
     // 检查标签是否存在
-    std::optional<int64_t> check_tag_exist(const std::string& tag_name);
+    std::optional<int64_t> check_tag_exist(TagHandle tag);
     
     // 生成新的标签ID
     int64_t generate_tag_id();
     
-    // 更新Artist标签（V3数据库）
-    void update_artist_tags();
+    // V3数据库：取得（必要时创建）Artist父标签，并把旧版本留下的 "Artist:xxx" 标签迁移到父标签下
+    void resolve_artist_tags();
 };
 
 } // namespace pixiv2billfish
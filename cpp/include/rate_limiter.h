@@ -0,0 +1,28 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+namespace pixiv2billfish {
+
+// 全局请求限速器：把请求均匀地排到时间轴上，多个线程（或多个图库）共用同一份速率预算
+class RateLimiter {
+public:
+    // requests_per_second <= 0 表示不限速
+    explicit RateLimiter(double requests_per_second = 0);
+    
+    // 设置速率
+    void set_rate(double requests_per_second);
+    
+    // 等待直到可以发出下一个请求
+    void acquire();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    
+    std::mutex mutex_;
+    Clock::duration interval_{0};
+    Clock::time_point next_slot_;
+};
+
+} // namespace pixiv2billfish
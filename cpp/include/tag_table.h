@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace pixiv2billfish {
+
+// 标签句柄：标签名在全局字符串表中的下标
+using TagHandle = uint32_t;
+
+// 全局标签字符串表：每个标签名只保存一份并分配稳定的句柄，
+// 之后的去重、查找都只比较整数，直到写入SQLite时才取回字符串
+class TagTable {
+public:
+    static TagTable& global();
+    
+    TagTable();
+    
+    TagTable(const TagTable&) = delete;
+    TagTable& operator=(const TagTable&) = delete;
+    
+    // 获取标签名的句柄，不存在时插入（线程安全）
+    TagHandle intern(std::string_view name);
+    
+    // 查找标签名的句柄，不插入
+    std::optional<TagHandle> find(std::string_view name) const;
+    
+    // 句柄对应的标签名，返回的视图在表的整个生命周期内有效
+    std::string_view name(TagHandle handle) const;
+    
+    // 已收录的标签数
+    size_t size() const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::pmr::monotonic_buffer_resource storage_;
+    std::vector<std::string_view> names_;
+    std::unordered_map<std::string_view, TagHandle> index_;
+};
+
+} // namespace pixiv2billfish
@@ -37,12 +37,21 @@ public:
     // 获取待处理任务数
     size_t pending_tasks() const;
     
+    // 调整工作线程数：增加时立即启动新线程；减少时多余的线程执行完手上的任务后退出，不中断任务
+    void resize(size_t num_threads);
+    
+    // 目标工作线程数
+    size_t size() const;
+    
     // 停止线程池
     void shutdown();
 
 private:
     // 工作线程
     std::vector<std::thread> workers_;
+    size_t target_threads_ = 0;                 // 目标线程数（受 queue_mutex_ 保护）
+    size_t retire_count_ = 0;                   // 等待退出的线程数
+    std::vector<std::thread::id> retired_;      // 已退出、尚未 join 的线程
     
     // 任务队列
     std::queue<std::function<void()>> tasks_;
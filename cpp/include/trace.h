@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pixiv2billfish {
+
+// 运行追踪：各线程把耗时区间记录到自己的环形缓冲区（写满后覆盖最旧的事件，记录时不加锁），
+// 结束时导出为 Chrome trace event JSON，可用 chrome://tracing 或 ui.perfetto.dev 打开。
+// 未启用时每个区间只多一次原子读取
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+    
+    // 开始记录（每个进程一次）；events_per_thread 为每个线程的环形缓冲区容量
+    static void start(const std::string& path, size_t events_per_thread);
+    
+    // 停止记录并写出追踪文件（应在工作线程空闲后调用）；未启用时直接返回 true
+    static bool stop();
+    
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    
+    // 记录一个区间；category、name、arg_name 只保存指针，须为字符串字面量
+    static void record(const char* category, const char* name, Clock::time_point start, Clock::time_point end,
+                       const char* arg_name = nullptr, int64_t arg = 0);
+
+private:
+    inline static std::atomic<bool> enabled_{false};
+};
+
+// 作用域区间：构造时计时，析构时记录
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name, const char* arg_name = nullptr, int64_t arg = 0)
+        : category_(category), name_(name), arg_name_(arg_name), arg_(arg), active_(Trace::enabled()) {
+        if (active_) {
+            start_ = Trace::Clock::now();
+        }
+    }
+    
+    ~TraceSpan() {
+        if (active_) {
+            Trace::record(category_, name_, start_, Trace::Clock::now(), arg_name_, arg_);
+        }
+    }
+    
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    const char* arg_name_;
+    int64_t arg_;
+    bool active_;
+    Trace::Clock::time_point start_;
+};
+
+} // namespace pixiv2billfish
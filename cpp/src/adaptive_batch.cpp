@@ -0,0 +1,59 @@
+#include "adaptive_batch.h"
+#include <algorithm>
+
+namespace pixiv2billfish {
+
+AdaptiveBatch::AdaptiveBatch(size_t initial_size, std::chrono::milliseconds target_commit,
+                             std::chrono::milliseconds max_lag)
+    : limit_(std::clamp(initial_size, kMinSize, kMaxSize)),
+      target_commit_(target_commit),
+      max_lag_(max_lag) {}
+
+void AdaptiveBatch::reconfigure(size_t initial_size, std::chrono::milliseconds target_commit,
+                                std::chrono::milliseconds max_lag) {
+    limit_ = std::clamp(initial_size, kMinSize, kMaxSize);
+    row_cost_us_ = 0;
+    target_commit_ = target_commit;
+    max_lag_ = max_lag;
+}
+
+void AdaptiveBatch::mark_pending() {
+    if (!has_pending_) {
+        has_pending_ = true;
+        first_pending_ = Clock::now();
+    }
+}
+
+bool AdaptiveBatch::should_flush(size_t pending) const {
+    if (pending == 0) {
+        return false;
+    }
+    if (pending >= limit_) {
+        return true;
+    }
+    return has_pending_ && max_lag_.count() > 0 && Clock::now() - first_pending_ >= max_lag_;
+}
+
+void AdaptiveBatch::record_commit(size_t rows, Clock::duration elapsed, bool success) {
+    if (!success) {
+        return;
+    }
+    has_pending_ = false;
+    
+    if (rows == 0 || target_commit_.count() <= 0) {
+        return;
+    }
+    
+    double sample = std::chrono::duration<double, std::micro>(elapsed).count() / rows;
+    row_cost_us_ = row_cost_us_ == 0 ? sample : row_cost_us_ * 0.7 + sample * 0.3;
+    if (row_cost_us_ <= 0) {
+        return;
+    }
+    
+    // 每次最多翻倍或减半，避免一次异常耗时让批量大起大落
+    double ideal = target_commit_.count() / row_cost_us_;
+    double next = std::clamp(ideal, limit_ / 2.0, limit_ * 2.0);
+    limit_ = std::clamp(static_cast<size_t>(next), kMinSize, kMaxSize);
+}
+
+} // namespace pixiv2billfish
@@ -0,0 +1,38 @@
+#include "arena.h"
+
+namespace pixiv2billfish {
+
+namespace {
+
+thread_local std::pmr::memory_resource* active_resource = nullptr;
+
+} // namespace
+
+TaskArena::TaskArena()
+    : initial_buffer_(std::make_unique<std::byte[]>(kInitialSize)),
+      pool_(initial_buffer_.get(), kInitialSize, std::pmr::new_delete_resource()) {
+}
+
+TaskArena& TaskArena::local() {
+    thread_local TaskArena arena;
+    return arena;
+}
+
+ArenaScope::ArenaScope() : previous_(active_resource) {
+    active_resource = TaskArena::local().resource();
+}
+
+ArenaScope::~ArenaScope() {
+    active_resource = previous_;
+    
+    // 仅在最外层作用域结束时重置
+    if (!previous_) {
+        TaskArena::local().reset();
+    }
+}
+
+std::pmr::memory_resource* current_resource() {
+    return active_resource ? active_resource : std::pmr::new_delete_resource();
+}
+
+} // namespace pixiv2billfish
@@ -0,0 +1,146 @@
+#include "bundle.h"
+#include "memory_stats.h"
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+
+using json = nlohmann::json;
+
+namespace pixiv2billfish {
+
+BundleWriter::BundleWriter(const std::string& path) : path_(path) {}
+
+BundleWriter::~BundleWriter() {
+    close();
+}
+
+bool BundleWriter::open() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_.open(path_, std::ios::binary | std::ios::trunc);
+    if (!file_.is_open()) {
+        spdlog::error("无法创建元数据包: {}", path_);
+        return false;
+    }
+    return true;
+}
+
+void BundleWriter::write_tags(int64_t file_id, Pid pid, const TagList& tags) {
+    json j;
+    j["file_id"] = file_id;
+    j["pid"] = pid;
+    
+    json& names = j["tags"] = json::array();
+    for (TagHandle tag : tags) {
+        names.push_back(TagTable::global().name(tag));
+    }
+    
+    write_line(j.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void BundleWriter::write_note(int64_t file_id, Pid pid,
+                              std::string_view note, std::string_view origin) {
+    json j;
+    j["file_id"] = file_id;
+    j["pid"] = pid;
+    j["note"] = note;
+    j["origin"] = origin;
+    
+    write_line(j.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void BundleWriter::write_illust(Pid pid, const TagList& tags,
+                                std::string_view note, std::string_view origin) {
+    json j;
+    j["pid"] = pid;
+    
+    json& names = j["tags"] = json::array();
+    for (TagHandle tag : tags) {
+        names.push_back(TagTable::global().name(tag));
+    }
+    
+    j["note"] = note;
+    j["origin"] = origin;
+    
+    write_line(j.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+
+void BundleWriter::write_line(const std::string& line) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    file_ << line << '\n';
+    record_count_++;
+}
+
+bool BundleWriter::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_.is_open()) {
+        return true;
+    }
+    
+    file_.flush();
+    bool ok = static_cast<bool>(file_);
+    file_.close();
+    
+    if (!ok) {
+        spdlog::error("写入元数据包失败: {}", path_);
+    }
+    return ok;
+}
+
+size_t BundleWriter::record_count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return record_count_;
+}
+
+BundleReader::BundleReader(const std::string& path) : path_(path) {}
+
+bool BundleReader::open() {
+    file_.open(path_, std::ios::binary);
+    if (!file_.is_open()) {
+        spdlog::error("无法打开元数据包: {}", path_);
+        return false;
+    }
+    return true;
+}
+
+bool BundleReader::next(BundleRecord& record) {
+    MemoryStageScope memory_stage(MemoryStage::kJson);
+    while (std::getline(file_, line_)) {
+        line_number_++;
+        if (line_.empty()) {
+            continue;
+        }
+        
+        try {
+            json j = json::parse(line_);
+            
+            record = BundleRecord();
+            record.file_id = j.value("file_id", int64_t{0});
+            auto pid = j.find("pid");
+            if (pid != j.end()) {
+                record.pid = pid->is_string() ? std::stoull(pid->get<std::string>()) : pid->get<Pid>();
+            }
+            
+            if (j.contains("tags")) {
+                record.has_tags = true;
+                for (const auto& tag : j["tags"]) {
+                    record.tags.push_back(TagTable::global().intern(tag.get_ref<const std::string&>()));
+                }
+            }
+            
+            if (j.contains("note")) {
+                record.has_note = true;
+                record.note = j["note"].get<std::string>();
+                record.origin = j.value("origin", std::string());
+            }
+            
+            return true;
+            
+        } catch (const std::exception& e) {
+            error_count_++;
+            spdlog::warn("元数据包 {} 第 {} 行格式错误: {}", path_, line_number_, e.what());
+        }
+    }
+    
+    return false;
+}
+
+} // namespace pixiv2billfish
@@ -1,6 +1,7 @@
 #include "config.h"
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <filesystem>
 #include <spdlog/spdlog.h>
 
 using json = nlohmann::json;
@@ -19,6 +20,7 @@ bool Config::load_from_file(const std::string& filename) {
         
         // 加载配置项
         if (j.contains("db_path")) db_path = j["db_path"];
+        if (j.contains("db_paths")) db_paths = j["db_paths"].get<std::vector<std::string>>();
         if (j.contains("use_proxies")) use_proxies = j["use_proxies"];
         if (j.contains("http_proxy")) http_proxy = j["http_proxy"];
         if (j.contains("https_proxy")) https_proxy = j["https_proxy"];
@@ -27,11 +29,34 @@ bool Config::load_from_file(const std::string& filename) {
         if (j.contains("skip_existing")) skip_existing = j["skip_existing"];
         if (j.contains("start_file_num")) start_file_num = j["start_file_num"];
         if (j.contains("end_file_num")) end_file_num = j["end_file_num"];
+        if (j.contains("incremental")) incremental = j["incremental"];
+        if (j.contains("state_file")) state_file = j["state_file"];
+        if (j.contains("watch")) watch = j["watch"];
+        if (j.contains("watch_interval_ms")) watch_interval_ms = j["watch_interval_ms"];
         if (j.contains("tag_thread_count")) tag_thread_count = j["tag_thread_count"];
         if (j.contains("note_thread_count")) note_thread_count = j["note_thread_count"];
         if (j.contains("request_timeout")) request_timeout = j["request_timeout"];
         if (j.contains("retry_count")) retry_count = j["retry_count"];
         if (j.contains("request_delay_ms")) request_delay_ms = j["request_delay_ms"];
+        if (j.contains("max_requests_per_second")) max_requests_per_second = j["max_requests_per_second"];
+        if (j.contains("metadata_cache_size")) metadata_cache_size = j["metadata_cache_size"];
+        if (j.contains("batch_user_fetch")) batch_user_fetch = j["batch_user_fetch"];
+        if (j.contains("progress_interval_sec")) progress_interval_sec = j["progress_interval_sec"];
+        if (j.contains("note_template")) note_template = j["note_template"];
+        if (j.contains("read_connections")) read_connections = j["read_connections"];
+        if (j.contains("wal")) wal = j["wal"];
+        if (j.contains("batch_size_tag")) batch_size_tag = j["batch_size_tag"];
+        if (j.contains("batch_size_tag_join")) batch_size_tag_join = j["batch_size_tag_join"];
+        if (j.contains("batch_size_note")) batch_size_note = j["batch_size_note"];
+        if (j.contains("target_commit_ms")) target_commit_ms = j["target_commit_ms"];
+        if (j.contains("max_write_lag_ms")) max_write_lag_ms = j["max_write_lag_ms"];
+        if (j.contains("config_reload_interval_ms")) config_reload_interval_ms = j["config_reload_interval_ms"];
+        if (j.contains("trace_file")) trace_file = j["trace_file"];
+        if (j.contains("trace_buffer_events")) trace_buffer_events = j["trace_buffer_events"];
+        if (j.contains("pixiv_api_url")) pixiv_api_url = j["pixiv_api_url"];
+        if (j.contains("pixiv_artwork_url")) pixiv_artwork_url = j["pixiv_artwork_url"];
+        if (j.contains("pixiv_user_api_url")) pixiv_user_api_url = j["pixiv_user_api_url"];
+        if (j.contains("headers")) headers = j["headers"].get<std::map<std::string, std::string>>();
         
         spdlog::info("配置文件加载成功: {}", filename);
         return true;
@@ -47,6 +72,7 @@ bool Config::save_to_file(const std::string& filename) const {
         json j;
         
         j["db_path"] = db_path;
+        j["db_paths"] = db_paths;
         j["use_proxies"] = use_proxies;
         j["http_proxy"] = http_proxy;
         j["https_proxy"] = https_proxy;
@@ -55,11 +81,34 @@ bool Config::save_to_file(const std::string& filename) const {
         j["skip_existing"] = skip_existing;
         j["start_file_num"] = start_file_num;
         j["end_file_num"] = end_file_num;
+        j["incremental"] = incremental;
+        j["state_file"] = state_file;
+        j["watch"] = watch;
+        j["watch_interval_ms"] = watch_interval_ms;
         j["tag_thread_count"] = tag_thread_count;
         j["note_thread_count"] = note_thread_count;
         j["request_timeout"] = request_timeout;
         j["retry_count"] = retry_count;
         j["request_delay_ms"] = request_delay_ms;
+        j["max_requests_per_second"] = max_requests_per_second;
+        j["metadata_cache_size"] = metadata_cache_size;
+        j["batch_user_fetch"] = batch_user_fetch;
+        j["progress_interval_sec"] = progress_interval_sec;
+        j["note_template"] = note_template;
+        j["read_connections"] = read_connections;
+        j["wal"] = wal;
+        j["batch_size_tag"] = batch_size_tag;
+        j["batch_size_tag_join"] = batch_size_tag_join;
+        j["batch_size_note"] = batch_size_note;
+        j["target_commit_ms"] = target_commit_ms;
+        j["max_write_lag_ms"] = max_write_lag_ms;
+        j["config_reload_interval_ms"] = config_reload_interval_ms;
+        j["trace_file"] = trace_file;
+        j["trace_buffer_events"] = trace_buffer_events;
+        j["pixiv_api_url"] = pixiv_api_url;
+        j["pixiv_artwork_url"] = pixiv_artwork_url;
+        j["pixiv_user_api_url"] = pixiv_user_api_url;
+        j["headers"] = headers;
         
         std::ofstream file(filename);
         if (!file.is_open()) {
@@ -77,4 +126,71 @@ bool Config::save_to_file(const std::string& filename) const {
     }
 }
 
+std::string Config::sync_state_path() const {
+    return state_file.empty() ? db_path + ".sync.json" : state_file;
+}
+
+std::string Config::staging_path() const {
+    if (!staging_file.empty()) {
+        return staging_file;
+    }
+    return db_path + ".shard-" + std::to_string(shard_index) + "-of-" + std::to_string(shard_count) + ".ndjson";
+}
+
+bool SyncState::load_from_file(const std::string& filename) {
+    try {
+        std::ifstream file(filename);
+        if (!file.is_open()) {
+            return false;
+        }
+        
+        json j;
+        file >> j;
+        
+        if (j.contains("last_file_id")) last_file_id = j["last_file_id"];
+        if (j.contains("retry_attempts")) {
+            for (const auto& [file_id, attempts] : j["retry_attempts"].items()) {
+                retry_attempts[std::stoll(file_id)] = attempts.get<int>();
+            }
+        }
+        
+        return true;
+        
+    } catch (const std::exception& e) {
+        spdlog::error("加载同步状态失败: {}", e.what());
+        return false;
+    }
+}
+
+bool SyncState::save_to_file(const std::string& filename) const {
+    try {
+        json j;
+        j["last_file_id"] = last_file_id;
+        j["retry_attempts"] = json::object();
+        for (const auto& [file_id, attempts] : retry_attempts) {
+            j["retry_attempts"][std::to_string(file_id)] = attempts;
+        }
+        
+        // 先写临时文件再替换，避免中途退出留下损坏的状态
+        std::string temp_file = filename + ".tmp";
+        {
+            std::ofstream file(temp_file, std::ios::trunc);
+            if (!file.is_open()) {
+                return false;
+            }
+            file << j.dump(4);
+            if (!file) {
+                return false;
+            }
+        }
+        
+        std::filesystem::rename(temp_file, filename);
+        return true;
+        
+    } catch (const std::exception& e) {
+        spdlog::error("保存同步状态失败: {}", e.what());
+        return false;
+    }
+}
+
 } // namespace pixiv2billfish
@@ -0,0 +1,130 @@
+#include "config_watcher.h"
+#include <spdlog/spdlog.h>
+
+namespace pixiv2billfish {
+
+namespace {
+
+// 不轮询修改时间时检查 SIGHUP 标志的间隔
+constexpr std::chrono::milliseconds kSignalCheckInterval(500);
+
+} // namespace
+
+std::atomic<bool> ConfigWatcher::reload_requested_{false};
+
+ConfigWatcher::Subscription::Subscription(Subscription&& other) noexcept
+    : watcher_(other.watcher_), id_(other.id_) {
+    other.watcher_ = nullptr;
+}
+
+ConfigWatcher::Subscription& ConfigWatcher::Subscription::operator=(Subscription&& other) noexcept {
+    if (this != &other) {
+        if (watcher_) {
+            watcher_->unsubscribe(id_);
+        }
+        watcher_ = other.watcher_;
+        id_ = other.id_;
+        other.watcher_ = nullptr;
+    }
+    return *this;
+}
+
+ConfigWatcher::Subscription::~Subscription() {
+    if (watcher_) {
+        watcher_->unsubscribe(id_);
+    }
+}
+
+ConfigWatcher::ConfigWatcher(std::string path, const Config& initial)
+    : path_(std::move(path)), current_(initial) {
+    last_write_time_ = read_write_time();
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+void ConfigWatcher::start() {
+    if (thread_.joinable()) {
+        return;
+    }
+    thread_ = std::thread(&ConfigWatcher::watch_loop, this);
+}
+
+void ConfigWatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+    stop_condition_.notify_all();
+    
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+ConfigWatcher::Subscription ConfigWatcher::subscribe(Listener listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    size_t id = next_id_++;
+    listeners_.emplace(id, std::move(listener));
+    return Subscription(this, id);
+}
+
+void ConfigWatcher::unsubscribe(size_t id) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    listeners_.erase(id);
+}
+
+void ConfigWatcher::request_reload() {
+    reload_requested_ = true;
+}
+
+std::filesystem::file_time_type ConfigWatcher::read_write_time() const {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(path_, ec);
+    return ec ? std::filesystem::file_time_type{} : time;
+}
+
+void ConfigWatcher::watch_loop() {
+    const int interval_ms = current_.config_reload_interval_ms;
+    const auto interval = interval_ms > 0 ? std::chrono::milliseconds(interval_ms) : kSignalCheckInterval;
+    
+    std::unique_lock<std::mutex> lock(stop_mutex_);
+    while (!stop_condition_.wait_for(lock, interval, [this] { return stop_; })) {
+        bool reload_needed = reload_requested_.exchange(false);
+        
+        if (interval_ms > 0) {
+            auto write_time = read_write_time();
+            if (write_time != std::filesystem::file_time_type{} && write_time != last_write_time_) {
+                last_write_time_ = write_time;
+                reload_needed = true;
+            }
+        }
+        
+        if (reload_needed) {
+            lock.unlock();
+            reload();
+            lock.lock();
+        }
+    }
+}
+
+void ConfigWatcher::reload() {
+    Config updated = current_;
+    if (!updated.load_from_file(path_)) {
+        spdlog::warn("重新加载配置失败，继续使用当前配置: {}", path_);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(listeners_mutex_);
+        for (const auto& [id, listener] : listeners_) {
+            listener(current_, updated);
+        }
+    }
+    
+    current_ = std::move(updated);
+    spdlog::info("配置已重新加载: {}", path_);
+}
+
+} // namespace pixiv2billfish
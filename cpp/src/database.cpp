@@ -1,36 +1,262 @@
 #include "database.h"
+#include "tag_table.h"
 #include <sqlite3.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <condition_variable>
 #include <stdexcept>
 
 namespace pixiv2billfish {
 
+namespace {
+
+// 单条多行 INSERT 的行数上限（同时保证参数总数低于 SQLite 默认的 999 个）
+constexpr size_t kMaxRowsPerStatement = 256;
+constexpr size_t kMaxParameters = 999;
+
+// 读写并发时等待对方释放锁的上限（毫秒）
+constexpr int kBusyTimeoutMs = 10000;
+
+bool execute_sql(sqlite3* db, const std::string& sql) {
+    char* err_msg = nullptr;
+    int rc = sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &err_msg);
+    
+    if (rc != SQLITE_OK) {
+        std::string error = err_msg ? err_msg : "Unknown error";
+        sqlite3_free(err_msg);
+        spdlog::error("SQL执行失败: {}", error);
+        return false;
+    }
+    
+    return true;
+}
+
+// 打开一个只读连接，失败时返回 nullptr
+sqlite3* open_reader(const std::string& path) {
+    sqlite3* db = nullptr;
+    int rc = sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+    
+    if (rc != SQLITE_OK) {
+        spdlog::error("无法以只读方式打开数据库: {}", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
+    
+    sqlite3_busy_timeout(db, kBusyTimeoutMs);
+    execute_sql(db, "PRAGMA temp_store = MEMORY");
+    execute_sql(db, "PRAGMA cache_size = 10000");
+    return db;
+}
+
+// 用多行 VALUES 语句把 count 行写入 sql_prefix（"INSERT INTO t (a, b) VALUES "）指定的表。
+// bind_row(stmt, param, i) 从第 param 个参数起绑定第 i 行
+template<typename BindRow>
+bool insert_rows(sqlite3* db, const std::string& sql_prefix, size_t columns, size_t count, BindRow bind_row) {
+    const size_t rows_per_statement = std::min(kMaxRowsPerStatement, kMaxParameters / columns);
+    
+    std::string row_sql = "(?";
+    for (size_t c = 1; c < columns; ++c) {
+        row_sql += ",?";
+    }
+    row_sql += ")";
+    
+    auto build_sql = [&](size_t rows) {
+        std::string sql = sql_prefix;
+        sql.reserve(sql.size() + rows * (row_sql.size() + 1));
+        for (size_t i = 0; i < rows; ++i) {
+            if (i > 0) {
+                sql += ',';
+            }
+            sql += row_sql;
+        }
+        return sql;
+    };
+    
+    // 整块与剩余部分各准备一条语句
+    auto run = [&](size_t offset, size_t rows) {
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, build_sql(rows).c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            spdlog::error("准备批量插入语句失败: {}", sqlite3_errmsg(db));
+            return false;
+        }
+        
+        bool ok = true;
+        for (size_t first = offset; ok && first + rows <= count; first += rows) {
+            int param = 1;
+            for (size_t i = first; i < first + rows; ++i) {
+                bind_row(stmt, param, i);
+                param += static_cast<int>(columns);
+            }
+            
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                spdlog::error("批量插入失败: {}", sqlite3_errmsg(db));
+                ok = false;
+            }
+            
+            sqlite3_reset(stmt);
+        }
+        
+        sqlite3_finalize(stmt);
+        return ok;
+    };
+    
+    size_t full_rows = count - count % rows_per_statement;
+    if (full_rows > 0 && !run(0, rows_per_statement)) {
+        return false;
+    }
+    if (full_rows < count && !run(full_rows, count - full_rows)) {
+        return false;
+    }
+    return true;
+}
+
+// 执行返回两列整数的查询，结果追加到 rows
+bool select_id_pairs(sqlite3* db, const std::string& sql, std::vector<std::pair<int64_t, int64_t>>& rows) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        spdlog::error("准备SQL失败: {}", sqlite3_errmsg(db));
+        return false;
+    }
+    
+    int rc;
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        rows.emplace_back(sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1));
+    }
+    
+    sqlite3_finalize(stmt);
+    return rc == SQLITE_DONE;
+}
+
+// 数据库被锁或快照过期等，稍后重试可能成功的错误
+bool is_transient_error(sqlite3* db) {
+    int rc = sqlite3_errcode(db);
+    return rc == SQLITE_BUSY || rc == SQLITE_LOCKED;
+}
+
+// 读取 "SELECT id, name FROM bf_file ..." 的结果：先用 count_sql（同样的范围，
+// 返回行数与文件名总字节数）按实际大小预留 FileIndex，避免逐步扩容留下成倍的空余容量。
+// 两条语句的参数相同，由 bind(stmt) 绑定
+template<typename Bind>
+FileIndex read_files(sqlite3* db, const char* count_sql, const char* select_sql, Bind bind) {
+    FileIndex files;
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, count_sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        bind(stmt);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            files.reserve(static_cast<size_t>(sqlite3_column_int64(stmt, 0)),
+                          static_cast<size_t>(sqlite3_column_int64(stmt, 1)));
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    int rc = sqlite3_prepare_v2(db, select_sql, -1, &stmt, nullptr);
+    
+    if (rc != SQLITE_OK) {
+        spdlog::error("准备SQL失败: {}", sqlite3_errmsg(db));
+        return files;
+    }
+    
+    bind(stmt);
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        int name_size = sqlite3_column_bytes(stmt, 1);
+        files.add(sqlite3_column_int64(stmt, 0),
+                  name ? std::string_view(name, static_cast<size_t>(name_size)) : std::string_view());
+    }
+    
+    sqlite3_finalize(stmt);
+    return files;
+}
+
+} // namespace
+
 class Database::Impl {
 public:
-    sqlite3* db_ = nullptr;
+    sqlite3* db_ = nullptr;  // 写连接
     std::string db_path_;
     
+    // 只读连接池（为空时读操作与写操作共用写连接）
+    std::vector<sqlite3*> readers_;
+    std::vector<sqlite3*> idle_readers_;
+    std::mutex pool_mutex_;
+    std::condition_variable pool_available_;
+    
     explicit Impl(const std::string& path) : db_path_(path) {}
     
     ~Impl() {
+        close_readers();
         if (db_) {
             sqlite3_close(db_);
         }
     }
     
     bool execute(const std::string& sql) {
-        char* err_msg = nullptr;
-        int rc = sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg);
+        return execute_sql(db_, sql);
+    }
+    
+    // 写连接上的临时暂存表（内存中）：批量数据先整批载入，再用一条 INSERT … SELECT 写入正式表
+    bool ensure_staging_tables() {
+        if (staging_ready_) {
+            return true;
+        }
+        staging_ready_ =
+            execute("CREATE TEMP TABLE IF NOT EXISTS stage_tag (id INTEGER PRIMARY KEY, name TEXT, pid INTEGER)") &&
+            execute("CREATE TEMP TABLE IF NOT EXISTS stage_tag_join (file_id INTEGER, tag_id INTEGER)") &&
+            execute("CREATE TEMP TABLE IF NOT EXISTS stage_note (file_id INTEGER PRIMARY KEY, note TEXT, origin TEXT)");
+        return staging_ready_;
+    }
+    
+    bool staging_ready_ = false;
+    
+    void close_readers() {
+        for (sqlite3* reader : readers_) {
+            sqlite3_close(reader);
+        }
+        readers_.clear();
+        idle_readers_.clear();
+    }
+    
+    // 一次读操作使用的连接：有只读连接池时借出一个空闲连接（用完归还），
+    // 否则持有写连接的锁，与写操作串行
+    class ReadConnection {
+    public:
+        ReadConnection(Impl& impl, std::mutex& writer_mutex) : impl_(impl) {
+            if (impl_.readers_.empty()) {
+                writer_lock_ = std::unique_lock<std::mutex>(writer_mutex);
+                db_ = impl_.db_;
+                return;
+            }
+            
+            std::unique_lock<std::mutex> lock(impl_.pool_mutex_);
+            impl_.pool_available_.wait(lock, [this] { return !impl_.idle_readers_.empty(); });
+            db_ = impl_.idle_readers_.back();
+            impl_.idle_readers_.pop_back();
+        }
         
-        if (rc != SQLITE_OK) {
-            std::string error = err_msg ? err_msg : "Unknown error";
-            sqlite3_free(err_msg);
-            spdlog::error("SQL执行失败: {}", error);
-            return false;
+        ~ReadConnection() {
+            if (writer_lock_.owns_lock()) {
+                return;
+            }
+            
+            {
+                std::lock_guard<std::mutex> lock(impl_.pool_mutex_);
+                impl_.idle_readers_.push_back(db_);
+            }
+            impl_.pool_available_.notify_one();
         }
         
-        return true;
-    }
+        ReadConnection(const ReadConnection&) = delete;
+        ReadConnection& operator=(const ReadConnection&) = delete;
+        
+        sqlite3* get() const { return db_; }
+    
+    private:
+        Impl& impl_;
+        sqlite3* db_ = nullptr;
+        std::unique_lock<std::mutex> writer_lock_;
+    };
 };
 
 Database::Database(const std::string& db_path) 
@@ -40,7 +266,7 @@ Database::~Database() {
     close();
 }
 
-bool Database::open() {
+bool Database::open(const DatabaseOptions& options) {
     int rc = sqlite3_open(pimpl_->db_path_.c_str(), &pimpl_->db_);
     
     if (rc != SQLITE_OK) {
@@ -50,14 +276,44 @@ bool Database::open() {
     
     // 设置性能优化参数
     pimpl_->execute("PRAGMA synchronous = OFF");
-    pimpl_->execute("PRAGMA journal_mode = MEMORY");
+    pimpl_->execute(options.wal ? "PRAGMA journal_mode = WAL" : "PRAGMA journal_mode = MEMORY");
     pimpl_->execute("PRAGMA temp_store = MEMORY");
     pimpl_->execute("PRAGMA cache_size = 10000");
+    sqlite3_busy_timeout(pimpl_->db_, kBusyTimeoutMs);
+    
+    // 只读连接池
+    for (int i = 0; i < options.read_connections; ++i) {
+        sqlite3* reader = open_reader(pimpl_->db_path_);
+        if (!reader) {
+            close();
+            return false;
+        }
+        pimpl_->readers_.push_back(reader);
+    }
+    pimpl_->idle_readers_ = pimpl_->readers_;
+    
+    if (!pimpl_->readers_.empty()) {
+        spdlog::info("只读连接池: {} 个连接{}", pimpl_->readers_.size(), options.wal ? " (WAL)" : "");
+    }
     
     return true;
 }
 
+bool Database::open_read_only() {
+    pimpl_->db_ = open_reader(pimpl_->db_path_);
+    return pimpl_->db_ != nullptr;
+}
+
+bool Database::has_read_pool() const {
+    return !pimpl_->readers_.empty();
+}
+
+const std::string& Database::path() const {
+    return pimpl_->db_path_;
+}
+
 void Database::close() {
+    pimpl_->close_readers();
     if (pimpl_->db_) {
         sqlite3_close(pimpl_->db_);
         pimpl_->db_ = nullptr;
@@ -65,10 +321,12 @@ void Database::close() {
 }
 
 bool Database::is_version_3() {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
+    
     const char* sql = "SELECT * FROM sqlite_master WHERE type = 'table' AND tbl_name = 'bf_tag_v2';";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
         return false;
@@ -80,68 +338,79 @@ bool Database::is_version_3() {
     return has_table;
 }
 
-int64_t Database::get_file_count() {
-    const char* sql = "SELECT COUNT(*) FROM bf_file";
+int64_t Database::get_data_version() {
+    std::lock_guard<std::mutex> lock(mutex_);
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(pimpl_->db_, "PRAGMA data_version", -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
         return 0;
     }
     
-    int64_t count = 0;
+    int64_t version = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        count = sqlite3_column_int64(stmt, 0);
+        version = sqlite3_column_int64(stmt, 0);
     }
     
     sqlite3_finalize(stmt);
-    return count;
+    return version;
 }
 
-std::vector<FileRecord> Database::get_files(int start, int limit) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<FileRecord> files;
+int64_t Database::get_file_count() {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
     
-    const char* sql = "SELECT id, name FROM bf_file LIMIT ? OFFSET ?";
+    const char* sql = "SELECT COUNT(*) FROM bf_file";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
-        spdlog::error("准备SQL失败: {}", sqlite3_errmsg(pimpl_->db_));
-        return files;
+        return 0;
     }
     
-    sqlite3_bind_int(stmt, 1, limit);
-    sqlite3_bind_int(stmt, 2, start);
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        FileRecord file;
-        file.id = sqlite3_column_int64(stmt, 0);
-        
-        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        if (name) {
-            file.name = name;
-        }
-        
-        files.push_back(file);
+    int64_t count = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int64(stmt, 0);
     }
     
     sqlite3_finalize(stmt);
-    return files;
+    return count;
+}
+
+FileIndex Database::get_files(int start, int limit) {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
+    
+    return read_files(conn.get(),
+        "SELECT COUNT(*), TOTAL(LENGTH(CAST(name AS BLOB))) FROM (SELECT name FROM bf_file LIMIT ? OFFSET ?)",
+        "SELECT id, name FROM bf_file LIMIT ? OFFSET ?",
+        [&](sqlite3_stmt* stmt) {
+            sqlite3_bind_int(stmt, 1, limit);
+            sqlite3_bind_int(stmt, 2, start);
+        });
+}
+
+FileIndex Database::get_files_after(int64_t after_id) {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
+    
+    return read_files(conn.get(),
+        "SELECT COUNT(*), TOTAL(LENGTH(CAST(name AS BLOB))) FROM bf_file WHERE id > ?",
+        "SELECT id, name FROM bf_file WHERE id > ? ORDER BY id",
+        [&](sqlite3_stmt* stmt) {
+            sqlite3_bind_int64(stmt, 1, after_id);
+        });
 }
 
 std::vector<TagRecord> Database::get_tags(bool is_v3) {
-    std::lock_guard<std::mutex> lock(mutex_);
+    Impl::ReadConnection conn(*pimpl_, mutex_);
     std::vector<TagRecord> tags;
     
     std::string sql = is_v3 ? 
-        "SELECT id, name FROM bf_tag_v2" : 
-        "SELECT id, name FROM bf_tag";
+        "SELECT id, name, pid FROM bf_tag_v2" : 
+        "SELECT id, name, 0 FROM bf_tag";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql.c_str(), -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql.c_str(), -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
         return tags;
@@ -153,8 +422,10 @@ std::vector<TagRecord> Database::get_tags(bool is_v3) {
         
         const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
         if (name) {
-            tag.name = name;
+            tag.name = TagTable::global().name(TagTable::global().intern(
+                std::string_view(name, sqlite3_column_bytes(stmt, 1))));
         }
+        tag.parent_id = sqlite3_column_int64(stmt, 2);
         
         tags.push_back(tag);
     }
@@ -163,57 +434,48 @@ std::vector<TagRecord> Database::get_tags(bool is_v3) {
     return tags;
 }
 
-std::vector<TagJoinFileRecord> Database::get_tag_join_files() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<TagJoinFileRecord> records;
+std::vector<int64_t> Database::get_tagged_file_ids() {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
+    std::vector<int64_t> file_ids;
     
-    const char* sql = "SELECT file_id, tag_id FROM bf_tag_join_file";
+    // 只需要文件ID：走 file_id 索引，不读取关联行本身
+    const char* sql = "SELECT DISTINCT file_id FROM bf_tag_join_file";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
-        return records;
+        return file_ids;
     }
     
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        TagJoinFileRecord record;
-        record.file_id = sqlite3_column_int64(stmt, 0);
-        record.tag_id = sqlite3_column_int64(stmt, 1);
-        records.push_back(record);
+        file_ids.push_back(sqlite3_column_int64(stmt, 0));
     }
     
     sqlite3_finalize(stmt);
-    return records;
+    return file_ids;
 }
 
-std::vector<NoteRecord> Database::get_notes() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<NoteRecord> notes;
+std::vector<int64_t> Database::get_noted_file_ids() {
+    Impl::ReadConnection conn(*pimpl_, mutex_);
+    std::vector<int64_t> file_ids;
     
-    const char* sql = "SELECT file_id, note FROM bf_material_userdata";
+    // 只判断备注是否为空，不把备注正文读出来
+    const char* sql = "SELECT file_id FROM bf_material_userdata WHERE note <> ''";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
-        return notes;
+        return file_ids;
     }
     
     while (sqlite3_step(stmt) == SQLITE_ROW) {
-        NoteRecord note;
-        note.file_id = sqlite3_column_int64(stmt, 0);
-        
-        const char* note_text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        if (note_text) {
-            note.note = note_text;
-        }
-        
-        notes.push_back(note);
+        file_ids.push_back(sqlite3_column_int64(stmt, 0));
     }
     
     sqlite3_finalize(stmt);
-    return notes;
+    return file_ids;
 }
 
 bool Database::begin_transaction() {
@@ -225,132 +487,195 @@ bool Database::commit_transaction() {
 }
 
 bool Database::rollback_transaction() {
+    // 暂存表可能是在这个事务里创建的，回滚后需要重新创建
+    pimpl_->staging_ready_ = false;
     return pimpl_->execute("ROLLBACK");
 }
 
-bool Database::insert_tags(const std::vector<TagRecord>& tags, bool is_v3) {
-    if (tags.empty()) return true;
+TagInsertResult Database::insert_tags(const std::vector<TagRecord>& tags, bool is_v3) {
+    TagInsertResult result;
+    if (tags.empty()) {
+        result.ok = true;
+        return result;
+    }
     
     std::lock_guard<std::mutex> lock(mutex_);
+    sqlite3* db = pimpl_->db_;
     
-    std::string sql = is_v3 ?
-        "INSERT INTO bf_tag_v2 (id, name) VALUES (?, ?)" :
-        "INSERT INTO bf_tag (id, name) VALUES (?, ?)";
+    if (!pimpl_->ensure_staging_tables()) {
+        return result;
+    }
     
     begin_transaction();
     
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql.c_str(), -1, &stmt, nullptr);
-    
-    if (rc != SQLITE_OK) {
-        rollback_transaction();
-        return false;
-    }
-    
-    for (const auto& tag : tags) {
-        sqlite3_bind_int64(stmt, 1, tag.id);
-        sqlite3_bind_text(stmt, 2, tag.name.c_str(), -1, SQLITE_TRANSIENT);
-        
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            spdlog::error("插入标签失败: {}", tag.name);
+    bool ok = insert_rows(db, "INSERT OR REPLACE INTO temp.stage_tag (id, name, pid) VALUES ", 3, tags.size(),
+        [&tags](sqlite3_stmt* stmt, int param, size_t i) {
+            const TagRecord& tag = tags[i];
+            sqlite3_bind_int64(stmt, param, tag.id);
+            sqlite3_bind_text(stmt, param + 1, tag.name.data(), static_cast<int>(tag.name.size()), SQLITE_STATIC);
+            if (tag.parent_id != 0) {
+                sqlite3_bind_int64(stmt, param + 2, tag.parent_id);
+            } else {
+                sqlite3_bind_null(stmt, param + 2);
+            }
+        });
+    
+    // 同名标签已存在（例如 Billfish 在加载缓存后创建的）时改用已有标签，不写入重复的名称
+    std::string table = is_v3 ? "main.bf_tag_v2" : "main.bf_tag";
+    std::string same_name = "FROM temp.stage_tag s JOIN " + table + " t ON t.name = s.name" +
+                            (is_v3 ? " AND IFNULL(t.pid, 0) = IFNULL(s.pid, 0)" : "");
+    ok = ok && select_id_pairs(db, "SELECT s.id, MIN(t.id) " + same_name + " GROUP BY s.id", result.remapped) &&
+         pimpl_->execute("DELETE FROM temp.stage_tag WHERE id IN (SELECT s.id " + same_name + ")");
+    
+    // 暂定ID已被其他标签占用时，在事务内从当前最大ID之后重新分配
+    std::vector<std::pair<int64_t, int64_t>> taken;
+    ok = ok && select_id_pairs(db,
+        "SELECT s.id, (SELECT MAX(id) FROM (SELECT MAX(id) AS id FROM " + table +
+        " UNION ALL SELECT MAX(id) FROM temp.stage_tag)) "
+        "FROM temp.stage_tag s JOIN " + table + " t ON t.id = s.id", taken);
+    
+    if (ok && !taken.empty()) {
+        sqlite3_stmt* stmt;
+        ok = sqlite3_prepare_v2(db, "UPDATE temp.stage_tag SET id = ? WHERE id = ?", -1, &stmt, nullptr) == SQLITE_OK;
+        int64_t next_id = taken.front().second + 1;
+        for (size_t i = 0; ok && i < taken.size(); ++i) {
+            sqlite3_bind_int64(stmt, 1, next_id);
+            sqlite3_bind_int64(stmt, 2, taken[i].first);
+            ok = sqlite3_step(stmt) == SQLITE_DONE;
+            sqlite3_reset(stmt);
+            result.remapped.emplace_back(taken[i].first, next_id++);
         }
-        
-        sqlite3_reset(stmt);
+        sqlite3_finalize(stmt);
+        spdlog::warn("{} 个新标签的ID已被其他标签占用，已重新分配", taken.size());
     }
     
-    sqlite3_finalize(stmt);
-    commit_transaction();
+    ok = ok && pimpl_->execute(is_v3 ?
+        "INSERT INTO bf_tag_v2 (id, name, pid) SELECT id, name, pid FROM temp.stage_tag" :
+        "INSERT INTO bf_tag (id, name) SELECT id, name FROM temp.stage_tag");
     
-    return true;
+    ok = ok && pimpl_->execute("DELETE FROM temp.stage_tag");
+    
+    if (!ok) {
+        result.retryable = is_transient_error(db);
+        spdlog::error("插入标签失败: {} 个{}", tags.size(), result.retryable ? "（数据库繁忙，稍后重试）" : "");
+        result.remapped.clear();
+        rollback_transaction();  // 暂存表的写入一并回滚
+        return result;
+    }
+    
+    result.ok = commit_transaction();
+    if (!result.ok) {
+        result.retryable = is_transient_error(db);
+        result.remapped.clear();
+        rollback_transaction();
+    }
+    return result;
 }
 
-bool Database::insert_tag_join_files(const std::vector<TagJoinFileRecord>& records) {
+bool Database::insert_tag_join_files(const std::vector<TagJoinFileRecord>& records, bool skip_tagged_files) {
     if (records.empty()) return true;
     
     std::lock_guard<std::mutex> lock(mutex_);
     
-    const char* sql = "INSERT INTO bf_tag_join_file (file_id, tag_id) VALUES (?, ?)";
+    auto bind_join = [&records](sqlite3_stmt* stmt, int param, size_t i) {
+        sqlite3_bind_int64(stmt, param, records[i].file_id);
+        sqlite3_bind_int64(stmt, param + 1, records[i].tag_id);
+    };
     
     begin_transaction();
     
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    bool ok = true;
+    int64_t inserted = 0;
+    
+    if (!skip_tagged_files) {
+        // 不需要按文件过滤时直接多行写入，已存在的关联由 OR IGNORE 跳过
+        ok = insert_rows(pimpl_->db_, "INSERT OR IGNORE INTO bf_tag_join_file (file_id, tag_id) VALUES ", 2,
+                         records.size(), bind_join);
+    } else {
+        // 整批先载入暂存表，去掉已有任何标签的文件（按 file_id 索引逐个探测），再一条语句写入。
+        // 必须整批过滤：同一文件的关联若分在不同语句里，后一条会把前一条刚写入的关联当成已有标签
+        ok = pimpl_->ensure_staging_tables() &&
+             insert_rows(pimpl_->db_, "INSERT INTO temp.stage_tag_join (file_id, tag_id) VALUES ", 2,
+                         records.size(), bind_join) &&
+             pimpl_->execute(
+                 "DELETE FROM temp.stage_tag_join WHERE EXISTS "
+                 "(SELECT 1 FROM main.bf_tag_join_file j WHERE j.file_id = temp.stage_tag_join.file_id)") &&
+             pimpl_->execute(
+                 "INSERT OR IGNORE INTO bf_tag_join_file (file_id, tag_id) "
+                 "SELECT file_id, tag_id FROM temp.stage_tag_join");
+        if (ok) {
+            inserted = sqlite3_changes(pimpl_->db_);
+        }
+        ok = ok && pimpl_->execute("DELETE FROM temp.stage_tag_join");
+    }
     
-    if (rc != SQLITE_OK) {
+    if (!ok) {
         rollback_transaction();
         return false;
     }
     
-    for (const auto& record : records) {
-        sqlite3_bind_int64(stmt, 1, record.file_id);
-        sqlite3_bind_int64(stmt, 2, record.tag_id);
-        
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            // 忽略重复插入错误
-        }
-        
-        sqlite3_reset(stmt);
+    if (skip_tagged_files && inserted < static_cast<int64_t>(records.size())) {
+        spdlog::debug("文件-标签关联: 写入 {} / {} 条（其余已存在或文件已有标签）", inserted, records.size());
     }
     
-    sqlite3_finalize(stmt);
-    commit_transaction();
-    
-    return true;
+    return commit_transaction();
 }
 
-bool Database::insert_notes(const std::vector<NoteRecord>& notes) {
+bool Database::insert_notes(const std::vector<NoteRecord>& notes, bool skip_noted_files) {
     if (notes.empty()) return true;
     
     std::lock_guard<std::mutex> lock(mutex_);
     
-    const char* sql = "INSERT INTO bf_material_userdata (file_id, note, origin) VALUES (?, ?, ?)";
+    if (!pimpl_->ensure_staging_tables()) {
+        return false;
+    }
     
     begin_transaction();
     
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
-    
-    if (rc != SQLITE_OK) {
-        rollback_transaction();
-        return false;
+    bool ok = insert_rows(pimpl_->db_, "INSERT OR REPLACE INTO temp.stage_note (file_id, note, origin) VALUES ", 3,
+        notes.size(), [&notes](sqlite3_stmt* stmt, int param, size_t i) {
+            const NoteRecord& record = notes[i];
+            sqlite3_bind_int64(stmt, param, record.file_id);
+            sqlite3_bind_text(stmt, param + 1, record.note.data(), static_cast<int>(record.note.size()), SQLITE_STATIC);
+            sqlite3_bind_text(stmt, param + 2, record.origin.data(), static_cast<int>(record.origin.size()), SQLITE_STATIC);
+        });
+    
+    // 已有记录只更新备注与来源（保留评分、旋转等其他列；表上的 ON CONFLICT REPLACE 会整行替换），
+    // skip_noted_files 时不覆盖已有非空备注
+    std::string update_sql =
+        "UPDATE bf_material_userdata "
+        "SET (note, origin) = (SELECT s.note, s.origin FROM temp.stage_note s WHERE s.file_id = bf_material_userdata.file_id) "
+        "WHERE file_id IN (SELECT file_id FROM temp.stage_note)";
+    if (skip_noted_files) {
+        update_sql += " AND (note IS NULL OR note = '')";
     }
     
-    for (const auto& note_record : notes) {
-        sqlite3_bind_int64(stmt, 1, note_record.file_id);
-        sqlite3_bind_text(stmt, 2, note_record.note.c_str(), -1, SQLITE_TRANSIENT);
-        
-        // origin从note中提取（格式化时包含）
-        std::string origin;
-        size_t pos = note_record.note.find("Origin:");
-        if (pos != std::string::npos) {
-            size_t end = note_record.note.find("\r\n", pos);
-            if (end != std::string::npos) {
-                origin = note_record.note.substr(pos + 7, end - pos - 7);
-            }
-        }
-        
-        sqlite3_bind_text(stmt, 3, origin.c_str(), -1, SQLITE_TRANSIENT);
-        
-        if (sqlite3_step(stmt) != SQLITE_DONE) {
-            spdlog::error("插入备注失败: file_id={}", note_record.file_id);
-        }
-        
-        sqlite3_reset(stmt);
-    }
+    ok = ok && pimpl_->execute(update_sql);
     
-    sqlite3_finalize(stmt);
-    commit_transaction();
+    // 没有记录的文件一次插入
+    ok = ok && pimpl_->execute(
+        "INSERT INTO bf_material_userdata (file_id, note, origin) "
+        "SELECT s.file_id, s.note, s.origin FROM temp.stage_note s "
+        "WHERE NOT EXISTS (SELECT 1 FROM bf_material_userdata u WHERE u.file_id = s.file_id)");
     
-    return true;
+    ok = ok && pimpl_->execute("DELETE FROM temp.stage_note");
+    
+    if (!ok) {
+        spdlog::error("插入备注失败: {} 条", notes.size());
+        rollback_transaction();  // 暂存表的写入一并回滚
+        return false;
+    }
+    
+    return commit_transaction();
 }
 
 std::optional<int64_t> Database::get_artist_tag_id() {
-    std::lock_guard<std::mutex> lock(mutex_);
+    Impl::ReadConnection conn(*pimpl_, mutex_);
     
     const char* sql = "SELECT id FROM bf_tag_v2 WHERE name='Artist'";
     
     sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
+    int rc = sqlite3_prepare_v2(conn.get(), sql, -1, &stmt, nullptr);
     
     if (rc != SQLITE_OK) {
         return std::nullopt;
@@ -384,35 +709,6 @@ bool Database::create_artist_tag() {
     return true;
 }
 
-std::vector<TagRecord> Database::get_artist_subtags() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::vector<TagRecord> tags;
-    
-    const char* sql = "SELECT id, name FROM bf_tag_v2 WHERE name LIKE 'Artist:%' AND (pid IS NULL OR pid = 0)";
-    
-    sqlite3_stmt* stmt;
-    int rc = sqlite3_prepare_v2(pimpl_->db_, sql, -1, &stmt, nullptr);
-    
-    if (rc != SQLITE_OK) {
-        return tags;
-    }
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        TagRecord tag;
-        tag.id = sqlite3_column_int64(stmt, 0);
-        
-        const char* name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
-        if (name) {
-            tag.name = name;
-        }
-        
-        tags.push_back(tag);
-    }
-    
-    sqlite3_finalize(stmt);
-    return tags;
-}
-
 bool Database::update_artist_tags(const std::vector<TagRecord>& tags, int64_t parent_id) {
     if (tags.empty()) return true;
     
@@ -432,12 +728,12 @@ bool Database::update_artist_tags(const std::vector<TagRecord>& tags, int64_t pa
     
     for (const auto& tag : tags) {
         // 移除 "Artist:" 前缀
-        std::string new_name = tag.name;
-        if (new_name.find("Artist:") == 0) {
+        std::string_view new_name = tag.name;
+        if (new_name.substr(0, 7) == "Artist:") {
             new_name = new_name.substr(7);
         }
         
-        sqlite3_bind_text(stmt, 1, new_name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 1, new_name.data(), static_cast<int>(new_name.size()), SQLITE_STATIC);
         sqlite3_bind_int64(stmt, 2, parent_id);
         sqlite3_bind_int64(stmt, 3, tag.id);
         
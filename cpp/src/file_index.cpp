@@ -0,0 +1,48 @@
+#include "file_index.h"
+#include "pixiv_api.h"
+#include <limits>
+#include <stdexcept>
+
+namespace pixiv2billfish {
+
+FileIndex::FileIndex() : name_offsets_{0} {}
+
+void FileIndex::reserve(size_t rows, size_t name_bytes) {
+    ids_.reserve(rows);
+    name_offsets_.reserve(rows + 1);
+    names_.reserve(name_bytes);
+}
+
+void FileIndex::add(int64_t id, std::string_view name) {
+    if (names_.size() + name.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("文件名总长度超出索引上限");
+    }
+    
+    ids_.push_back(id);
+    names_.append(name);
+    name_offsets_.push_back(static_cast<uint32_t>(names_.size()));
+}
+
+void FileIndex::classify() {
+    std::vector<std::string_view> names;
+    names.reserve(size());
+    for (Row row = 0; row < size(); ++row) {
+        names.push_back(name(row));
+    }
+    
+    pids_.resize(size());
+    PixivAPI::extract_pids(names.data(), names.size(), pids_.data());
+}
+
+double FileIndex::bytes_per_row() const {
+    if (empty()) {
+        return 0.0;
+    }
+    size_t bytes = ids_.capacity() * sizeof(int64_t) +
+                   name_offsets_.capacity() * sizeof(uint32_t) +
+                   names_.capacity() +
+                   pids_.capacity() * sizeof(Pid);
+    return static_cast<double>(bytes) / size();
+}
+
+} // namespace pixiv2billfish
@@ -1,184 +1,297 @@
 #include "http_client.h"
+#include "memory_stats.h"
+#include "trace.h"
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 #include <thread>
+#include <algorithm>
 #include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
 
 namespace pixiv2billfish {
 
+namespace {
+
+// 压缩响应的预估解压倍数（JSON 通常为 4-8 倍）
+constexpr size_t kCompressedSizeFactor = 6;
+
+// 回收缓冲区容量上限，避免个别超大响应长期占用内存
+constexpr size_t kMaxRecycledCapacity = 4 * 1024 * 1024;
+
+// 每个线程复用的响应缓冲区
+thread_local std::string recycled_buffer;
+
+// 每个线程复用的URL缓冲区（libcurl需要以'\0'结尾的字符串）
+thread_local std::string url_buffer;
+
+std::string acquire_buffer() {
+    std::string buffer = std::move(recycled_buffer);
+    recycled_buffer = std::string();
+    buffer.clear();
+    return buffer;
+}
+
+bool header_name_equals(const char* line, size_t length, const char* name) {
+    size_t i = 0;
+    for (; name[i] != '\0'; ++i) {
+        if (i >= length ||
+            std::tolower(static_cast<unsigned char>(line[i])) != name[i]) {
+            return false;
+        }
+    }
+    return i < length && line[i] == ':';
+}
+
+} // namespace
+
 class HttpClient::Impl {
 public:
-    Impl() : timeout_(5) {
-        curl_global_init(CURL_GLOBAL_DEFAULT);
+    Impl() : settings_(std::make_shared<Settings>()) {
+        if (!MemoryStats::init_curl()) {
+            curl_global_init(CURL_GLOBAL_DEFAULT);
+        }
     }
     
     ~Impl() {
         curl_global_cleanup();
     }
     
-    std::string http_proxy_;
-    std::string https_proxy_;
-    int timeout_;
-    std::map<std::string, std::string> headers_;
+    // 代理、超时与请求头。可在运行中替换：每次请求开始时取得当前快照，
+    // 进行中的请求继续使用旧快照，下一次请求使用新设置
+    struct Settings {
+        std::string http_proxy;
+        std::string https_proxy;
+        int timeout = 5;
+        std::map<std::string, std::string> headers;
+        curl_slist* header_list = nullptr;  // 由 headers 预先拼好的请求头
+        
+        Settings() = default;
+        Settings(const Settings& other)
+            : http_proxy(other.http_proxy), https_proxy(other.https_proxy),
+              timeout(other.timeout), headers(other.headers) {
+            build_header_list();
+        }
+        Settings& operator=(const Settings&) = delete;
+        
+        ~Settings() {
+            curl_slist_free_all(header_list);
+        }
+        
+        void build_header_list() {
+            curl_slist_free_all(header_list);
+            header_list = nullptr;
+            for (const auto& [key, value] : headers) {
+                std::string header = key + ": " + value;
+                header_list = curl_slist_append(header_list, header.c_str());
+            }
+        }
+    };
+    
+    std::shared_ptr<const Settings> settings() const {
+        std::lock_guard<std::mutex> lock(settings_mutex_);
+        return settings_;
+    }
     
-    static size_t write_callback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    // 复制当前设置，修改后整体替换
+    template<typename F>
+    void update_settings(F&& modify) {
+        std::lock_guard<std::mutex> lock(settings_mutex_);
+        auto updated = std::make_shared<Settings>(*settings_);
+        modify(*updated);
+        settings_ = std::move(updated);
+    }
+    
+    // 单次传输的上下文
+    struct Transfer {
+        std::string* body = nullptr;
+        size_t content_length = 0;
+        bool encoded = false;
+        bool sized = false;
+    };
+    
+    static size_t header_callback(char* buffer, size_t size, size_t nitems, Transfer* transfer) {
+        size_t total_size = size * nitems;
+        
+        // 每个响应头块以状态行开始（重定向、100 Continue、代理 CONNECT 会有多块），
+        // 只采用最后一块的长度与编码
+        if (total_size >= 5 && std::memcmp(buffer, "HTTP/", 5) == 0) {
+            transfer->content_length = 0;
+            transfer->encoded = false;
+            transfer->sized = false;
+        } else if (header_name_equals(buffer, total_size, "content-length")) {
+            transfer->content_length = std::strtoull(buffer + 15, nullptr, 10);
+        } else if (header_name_equals(buffer, total_size, "content-encoding")) {
+            transfer->encoded = true;
+        }
+        
+        return total_size;
+    }
+    
+    static size_t write_callback(void* contents, size_t size, size_t nmemb, Transfer* transfer) {
         size_t total_size = size * nmemb;
-        userp->append(static_cast<char*>(contents), total_size);
+        
+        // 异常不能穿过 libcurl 的C调用栈：分配失败时返回 0，由 libcurl 以写入错误结束本次传输
+        try {
+            // 首个数据块到达时按 Content-Length 一次性预分配（不超过回收上限，异常的长度不会导致过量分配）
+            if (!transfer->sized) {
+                transfer->sized = true;
+                size_t expected = std::min(transfer->content_length, kMaxRecycledCapacity);
+                if (transfer->encoded) {
+                    expected = std::min(expected * kCompressedSizeFactor, kMaxRecycledCapacity);
+                }
+                if (expected > transfer->body->capacity()) {
+                    transfer->body->reserve(expected);
+                }
+            }
+            
+            transfer->body->append(static_cast<char*>(contents), total_size);
+        } catch (const std::exception& e) {
+            spdlog::error("响应体写入失败: {}", e.what());
+            return 0;
+        }
         return total_size;
     }
-};
-
-HttpClient::HttpClient() : pimpl_(std::make_unique<Impl>()) {}
-
-HttpClient::~HttpClient() = default;
-
-void HttpClient::set_proxy(const std::string& http_proxy, const std::string& https_proxy) {
-    pimpl_->http_proxy_ = http_proxy;
-    pimpl_->https_proxy_ = https_proxy;
-}
-
-void HttpClient::set_timeout(int seconds) {
-    pimpl_->timeout_ = seconds;
-}
+    
+    std::optional<HttpResponse> perform(std::string_view url, const std::string* post_data,
+                                        int retry_count);
 
-void HttpClient::set_headers(const std::map<std::string, std::string>& headers) {
-    pimpl_->headers_ = headers;
-}
+private:
+    mutable std::mutex settings_mutex_;
+    std::shared_ptr<const Settings> settings_;
+};
 
-std::optional<HttpResponse> HttpClient::get(const std::string& url, int retry_count) {
+std::optional<HttpResponse> HttpClient::Impl::perform(std::string_view url,
+                                                      const std::string* post_data,
+                                                      int retry_count) {
+    MemoryStageScope memory_stage(MemoryStage::kHttp);
+    HttpResponse response;
+    response.success = false;
+    response.body = acquire_buffer();
+    url_buffer.assign(url);
+    std::shared_ptr<const Settings> settings = this->settings();
+    
     for (int attempt = 0; attempt < retry_count; ++attempt) {
         CURL* curl = curl_easy_init();
         if (!curl) {
             spdlog::error("CURL初始化失败");
-            return std::nullopt;
+            break;
         }
         
-        HttpResponse response;
-        response.success = false;
+        response.body.clear();
+        Transfer transfer;
+        transfer.body = &response.body;
         
         // 设置URL
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_URL, url_buffer.c_str());
+        
+        if (post_data) {
+            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data->c_str());
+        }
         
         // 设置回调
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Impl::write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+        
+        // 启用压缩传输（空字符串表示接受libcurl支持的全部编码，如gzip/br），由libcurl流式解压
+        curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
         
         // 设置超时
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, pimpl_->timeout_);
+        curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(settings->timeout));
         
         // 禁用SSL验证（与Python版本一致）
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
         
         // 设置代理
-        if (!pimpl_->http_proxy_.empty()) {
-            curl_easy_setopt(curl, CURLOPT_PROXY, pimpl_->http_proxy_.c_str());
+        if (!settings->http_proxy.empty()) {
+            curl_easy_setopt(curl, CURLOPT_PROXY, settings->http_proxy.c_str());
         }
         
         // 设置请求头
-        struct curl_slist* headers = nullptr;
-        for (const auto& [key, value] : pimpl_->headers_) {
-            std::string header = key + ": " + value;
-            headers = curl_slist_append(headers, header.c_str());
-        }
-        if (headers) {
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        if (settings->header_list) {
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, settings->header_list);
         }
         
         // 执行请求
-        CURLcode res = curl_easy_perform(curl);
+        CURLcode res;
+        {
+            TraceSpan trace("http", post_data ? "http post" : "http get", "attempt", attempt + 1);
+            res = curl_easy_perform(curl);
+        }
         
         if (res == CURLE_OK) {
             long http_code = 0;
             curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
             response.status_code = static_cast<int>(http_code);
             response.success = true;
-            
-            if (headers) {
-                curl_slist_free_all(headers);
-            }
-            curl_easy_cleanup(curl);
-            
-            return response;
         }
         
-        if (headers) {
-            curl_slist_free_all(headers);
-        }
         curl_easy_cleanup(curl);
         
+        if (response.success) {
+            return response;
+        }
+        
         // 重试前等待
         if (attempt < retry_count - 1) {
             spdlog::debug("请求失败，重试 {}/{}: {}", attempt + 1, retry_count, url);
+            TraceSpan retry_wait("wait", "retry backoff", "attempt", attempt + 1);
             std::this_thread::sleep_for(std::chrono::milliseconds(500));
         }
     }
     
+    HttpClient::recycle_buffer(std::move(response.body));
     spdlog::warn("请求失败，已达最大重试次数: {}", url);
     return std::nullopt;
 }
 
-std::optional<HttpResponse> HttpClient::post(const std::string& url, 
+HttpClient::HttpClient() : pimpl_(std::make_unique<Impl>()) {}
+
+HttpClient::~HttpClient() = default;
+
+void HttpClient::set_proxy(const std::string& http_proxy, const std::string& https_proxy) {
+    pimpl_->update_settings([&](Impl::Settings& settings) {
+        settings.http_proxy = http_proxy;
+        settings.https_proxy = https_proxy;
+    });
+}
+
+void HttpClient::set_timeout(int seconds) {
+    pimpl_->update_settings([seconds](Impl::Settings& settings) {
+        settings.timeout = seconds;
+    });
+}
+
+void HttpClient::set_headers(const std::map<std::string, std::string>& headers) {
+    pimpl_->update_settings([&headers](Impl::Settings& settings) {
+        settings.headers = headers;
+        settings.build_header_list();
+    });
+}
+
+std::optional<HttpResponse> HttpClient::get(std::string_view url, int retry_count) {
+    return pimpl_->perform(url, nullptr, retry_count);
+}
+
+std::optional<HttpResponse> HttpClient::post(std::string_view url,
                                              const std::string& data,
                                              int retry_count) {
-    for (int attempt = 0; attempt < retry_count; ++attempt) {
-        CURL* curl = curl_easy_init();
-        if (!curl) {
-            return std::nullopt;
-        }
-        
-        HttpResponse response;
-        response.success = false;
-        
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, Impl::write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, pimpl_->timeout_);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-        
-        if (!pimpl_->http_proxy_.empty()) {
-            curl_easy_setopt(curl, CURLOPT_PROXY, pimpl_->http_proxy_.c_str());
-        }
-        
-        struct curl_slist* headers = nullptr;
-        for (const auto& [key, value] : pimpl_->headers_) {
-            std::string header = key + ": " + value;
-            headers = curl_slist_append(headers, header.c_str());
-        }
-        if (headers) {
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-        }
-        
-        CURLcode res = curl_easy_perform(curl);
-        
-        if (res == CURLE_OK) {
-            long http_code = 0;
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            response.status_code = static_cast<int>(http_code);
-            response.success = true;
-            
-            if (headers) {
-                curl_slist_free_all(headers);
-            }
-            curl_easy_cleanup(curl);
-            
-            return response;
-        }
-        
-        if (headers) {
-            curl_slist_free_all(headers);
-        }
-        curl_easy_cleanup(curl);
-        
-        if (attempt < retry_count - 1) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        }
+    return pimpl_->perform(url, &data, retry_count);
+}
+
+void HttpClient::recycle_buffer(std::string&& buffer) {
+    if (buffer.capacity() > kMaxRecycledCapacity ||
+        buffer.capacity() <= recycled_buffer.capacity()) {
+        return;
     }
     
-    return std::nullopt;
+    recycled_buffer = std::move(buffer);
 }
 
 } // namespace pixiv2billfish
@@ -1,16 +1,208 @@
 #include "config.h"
+#include "config_watcher.h"
 #include "database.h"
 #include "processor.h"
+#include "trace.h"
 #include <spdlog/spdlog.h>
+#include <spdlog/async.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <csignal>
 #include <iostream>
 #include <memory>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 using namespace pixiv2billfish;
 
+// 监视模式的退出标志
+static std::atomic<bool> g_stop_requested{false};
+
+extern "C" void handle_stop_signal(int) {
+    g_stop_requested = true;
+}
+
+// SIGHUP：重新加载配置文件
+extern "C" void handle_reload_signal(int) {
+    ConfigWatcher::request_reload();
+}
+
+// 命令行参数
+struct CommandLine {
+    std::string config_file = "config.json";
+    int shard_index = 0;
+    int shard_count = 1;
+    std::string staging_file;
+    std::string fetch_file;                // 抓取模式的输出元数据包
+    std::vector<std::string> apply_files;  // 应用模式的输入元数据包
+    bool apply = false;
+};
+
+void print_usage(const char* program) {
+    std::cerr << "用法:\n"
+              << "  " << program << " [config.json] [--shard i/n] [--staging <暂存文件>]\n"
+              << "  " << program << " [config.json] [--shard i/n] --fetch <元数据包>\n"
+              << "  " << program << " [config.json] --apply <元数据包或暂存文件>...  (别名 --merge)\n";
+}
+
+// 解析 "i/n"
+bool parse_shard(std::string_view text, int& index, int& count) {
+    size_t slash = text.find('/');
+    if (slash == std::string_view::npos) {
+        return false;
+    }
+    
+    auto parse_int = [](std::string_view part, int& value) {
+        auto result = std::from_chars(part.data(), part.data() + part.size(), value);
+        return result.ec == std::errc() && result.ptr == part.data() + part.size();
+    };
+    
+    return parse_int(text.substr(0, slash), index) &&
+           parse_int(text.substr(slash + 1), count) &&
+           count >= 1 && index >= 0 && index < count;
+}
+
+bool parse_command_line(int argc, char* argv[], CommandLine& cmd) {
+    bool has_config_file = false;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        
+        if (arg == "--shard") {
+            if (i + 1 >= argc || !parse_shard(argv[++i], cmd.shard_index, cmd.shard_count)) {
+                std::cerr << "无效的分片参数，应为 --shard i/n (0 <= i < n)\n";
+                return false;
+            }
+        } else if (arg == "--staging") {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            cmd.staging_file = argv[++i];
+        } else if (arg == "--fetch") {
+            if (i + 1 >= argc) {
+                return false;
+            }
+            cmd.fetch_file = argv[++i];
+        } else if (arg == "--apply" || arg == "--merge") {
+            cmd.apply = true;
+            for (++i; i < argc; ++i) {
+                cmd.apply_files.emplace_back(argv[i]);
+            }
+            if (cmd.apply_files.empty()) {
+                std::cerr << arg << " 需要至少一个元数据包\n";
+                return false;
+            }
+        } else if (arg.substr(0, 2) != "--" && !has_config_file) {
+            cmd.config_file = std::string(arg);
+            has_config_file = true;
+        } else {
+            std::cerr << "未知参数: " << arg << "\n";
+            return false;
+        }
+    }
+    
+    if (cmd.apply && !cmd.fetch_file.empty()) {
+        std::cerr << "--fetch 与 --apply 不能同时使用\n";
+        return false;
+    }
+    
+    return true;
+}
+
+// 处理单个图库；api 为空时由处理器自行创建，watcher 非空时运行中接收重新加载的线程数与批量参数
+bool run_library(const Config& config, std::shared_ptr<PixivAPI> api, ConfigWatcher* watcher,
+                 const CommandLine* cmd = nullptr) {
+    // 打开数据库
+    DatabaseOptions options;
+    options.read_connections = config.read_connections;
+    options.wal = config.wal;
+    
+    Database db(config.db_path);
+    if (!db.open(options)) {
+        spdlog::error("无法打开数据库: {}", config.db_path);
+        return false;
+    }
+    
+    spdlog::info("数据库连接成功: {}", config.db_path);
+    
+    // 创建处理器
+    Processor processor(config, db, std::move(api));
+    
+    ConfigWatcher::Subscription subscription;
+    if (watcher) {
+        subscription = watcher->subscribe([&processor](const Config& previous, const Config& updated) {
+            processor.apply_runtime_config(previous, updated);
+        });
+    }
+    
+    // 运行处理
+    if (cmd && cmd->apply) {
+        return processor.apply(cmd->apply_files);
+    }
+    if (cmd && !cmd->fetch_file.empty()) {
+        return processor.fetch(cmd->fetch_file);
+    }
+    if (config.watch) {
+        return processor.watch(g_stop_requested);
+    }
+    return processor.run();
+}
+
+// 多图库模式：每个图库一个处理线程，共用同一个 PixivAPI（连接、限速与元数据缓存）
+bool run_libraries(const Config& config, ConfigWatcher& watcher) {
+    auto api = std::make_shared<PixivAPI>(config);
+    auto subscription = watcher.subscribe([&api](const Config& previous, const Config& updated) {
+        api->apply_runtime_config(previous, updated);
+    });
+    
+    std::vector<Config> configs;
+    for (const auto& path : config.db_paths) {
+        Config library = config;
+        library.db_path = path;
+        library.state_file.clear();  // 各图库的同步状态分别保存在 <db_path>.sync.json
+        configs.push_back(std::move(library));
+    }
+    
+    std::atomic<bool> all_ok{true};
+    std::vector<std::thread> threads;
+    for (const auto& library : configs) {
+        threads.emplace_back([&library, &api, &watcher, &all_ok] {
+            try {
+                if (!run_library(library, api, &watcher)) {
+                    spdlog::error("图库处理失败: {}", library.db_path);
+                    all_ok = false;
+                }
+            } catch (const std::exception& e) {
+                spdlog::error("图库 {} 发生异常: {}", library.db_path, e.what());
+                all_ok = false;
+            }
+        });
+    }
+    
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    
+    spdlog::info("=== 多图库统计 ===");
+    spdlog::info("  图库数: {}", configs.size());
+    spdlog::info("  插画请求: {}", api->request_count());
+    spdlog::info("  元数据缓存命中: {}", api->cache_hits());
+    
+    return all_ok;
+}
+
+// 异步日志队列容量（条）。队列满时丢弃最旧的消息，工作线程不会因日志输出而阻塞
+constexpr size_t kLogQueueSize = 8192;
+
 void setup_logger() {
     try {
+        // 日志由单个后台线程格式化并写入控制台与文件
+        spdlog::init_thread_pool(kLogQueueSize, 1);
+        
         // 控制台输出
         auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
         console_sink->set_level(spdlog::level::info);
@@ -22,8 +214,11 @@ void setup_logger() {
         
         // 创建logger
         std::vector<spdlog::sink_ptr> sinks {console_sink, file_sink};
-        auto logger = std::make_shared<spdlog::logger>("main", sinks.begin(), sinks.end());
+        auto logger = std::make_shared<spdlog::async_logger>(
+            "main", sinks.begin(), sinks.end(), spdlog::thread_pool(),
+            spdlog::async_overflow_policy::overrun_oldest);
         logger->set_level(spdlog::level::debug);
+        logger->flush_on(spdlog::level::warn);
         
         spdlog::set_default_logger(logger);
         spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] %v");
@@ -33,51 +228,123 @@ void setup_logger() {
     }
 }
 
+// 退出前报告溢出丢弃的日志条数，并等待后台线程写完队列中的日志
+void shutdown_logger() {
+    if (auto pool = spdlog::thread_pool()) {
+        size_t dropped = pool->overrun_counter();
+        if (dropped > 0) {
+            spdlog::warn("日志队列溢出，丢弃 {} 条日志", dropped);
+        }
+    }
+    spdlog::shutdown();
+}
+
 int main(int argc, char* argv[]) {
+    CommandLine cmd;
+    if (!parse_command_line(argc, argv, cmd)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    
     setup_logger();
     
+    // 所有返回路径都要排空异步日志队列
+    struct LoggerGuard {
+        ~LoggerGuard() { shutdown_logger(); }
+    } logger_guard;
+    
     spdlog::info("=== Pixiv2Billfish C++ Version ===");
     spdlog::info("高性能版本启动中...");
     
     try {
         // 加载配置
         Config config;
-        std::string config_file = "config.json";
-        
-        if (argc > 1) {
-            config_file = argv[1];
-        }
+        const std::string& config_file = cmd.config_file;
         
         if (!config.load_from_file(config_file)) {
             spdlog::warn("配置文件 {} 未找到，使用默认配置", config_file);
         }
         
+        config.shard_index = cmd.shard_index;
+        config.shard_count = cmd.shard_count;
+        config.staging_file = cmd.staging_file;
+        
+        bool offline_mode = config.sharded() || cmd.apply || !cmd.fetch_file.empty();
+        
+        if (offline_mode && !config.db_paths.empty()) {
+            spdlog::error("分片、抓取与应用模式不支持多图库 (db_paths)");
+            return 1;
+        }
+        
+        if ((config.sharded() || !cmd.fetch_file.empty()) && (config.incremental || config.watch)) {
+            spdlog::error("分片与抓取模式不支持增量同步与监视模式");
+            return 1;
+        }
+        
         // 打印配置信息
         spdlog::info("配置信息:");
-        spdlog::info("  数据库路径: {}", config.db_path);
+        if (config.db_paths.empty()) {
+            spdlog::info("  数据库路径: {}", config.db_path);
+        } else {
+            for (const auto& path : config.db_paths) {
+                spdlog::info("  数据库路径: {}", path);
+            }
+        }
         spdlog::info("  使用代理: {}", config.use_proxies ? "是" : "否");
         spdlog::info("  写入标签: {}", config.write_tag ? "是" : "否");
         spdlog::info("  写入备注: {}", config.write_note ? "是" : "否");
         spdlog::info("  跳过已存在: {}", config.skip_existing ? "是" : "否");
-        spdlog::info("  起始文件: {}", config.start_file_num);
-        spdlog::info("  结束文件: {}", config.end_file_num == 0 ? "全部" : std::to_string(config.end_file_num));
+        if (config.incremental) {
+            spdlog::info("  增量同步: 是 (状态文件: {})", config.sync_state_path());
+        } else {
+            spdlog::info("  起始文件: {}", config.start_file_num);
+            spdlog::info("  结束文件: {}", config.end_file_num == 0 ? "全部" : std::to_string(config.end_file_num));
+        }
+        spdlog::info("  监视模式: {}", config.watch ? "是" : "否");
+        if (config.sharded()) {
+            spdlog::info("  分片: {}/{} (暂存文件: {})", config.shard_index, config.shard_count, config.staging_path());
+        }
+        if (!cmd.fetch_file.empty()) {
+            spdlog::info("  抓取模式: 输出 {}", cmd.fetch_file);
+        }
+        if (cmd.apply) {
+            spdlog::info("  应用元数据包: {} 个", cmd.apply_files.size());
+        }
         spdlog::info("  标签线程数: {}", config.tag_thread_count);
         spdlog::info("  备注线程数: {}", config.note_thread_count);
         
-        // 打开数据库
-        Database db(config.db_path);
-        if (!db.open()) {
-            spdlog::error("无法打开数据库: {}", config.db_path);
-            return 1;
+        // 运行追踪：所有返回路径都写出已记录的事件
+        struct TraceGuard {
+            ~TraceGuard() { Trace::stop(); }
+        } trace_guard;
+        if (!config.trace_file.empty()) {
+            Trace::start(config.trace_file, static_cast<size_t>(std::max(config.trace_buffer_events, 1)));
+        }
+        
+        if (config.watch) {
+            std::signal(SIGINT, handle_stop_signal);
+            std::signal(SIGTERM, handle_stop_signal);
         }
         
-        spdlog::info("数据库连接成功");
+        // 运行中修改配置文件（或发送 SIGHUP）即可调整线程数、限速、超时、代理与批量参数，无需重启
+        ConfigWatcher watcher(config_file, config);
+#ifdef SIGHUP
+        std::signal(SIGHUP, handle_reload_signal);
+#endif
+        watcher.start();
         
-        // 创建处理器
-        Processor processor(config, db);
+        bool ok;
+        if (config.db_paths.empty()) {
+            auto api = std::make_shared<PixivAPI>(config);
+            auto subscription = watcher.subscribe([&api](const Config& previous, const Config& updated) {
+                api->apply_runtime_config(previous, updated);
+            });
+            ok = run_library(config, api, &watcher, &cmd);
+        } else {
+            ok = run_libraries(config, watcher);
+        }
         
-        // 运行处理
-        if (!processor.run()) {
+        if (!ok) {
             spdlog::error("处理失败");
             return 1;
         }
@@ -0,0 +1,293 @@
+#include "memory_stats.h"
+
+#ifdef PIXIV2BILLFISH_MEMORY_STATS
+
+#include <curl/curl.h>
+#include <spdlog/spdlog.h>
+#include <sqlite3.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace pixiv2billfish {
+
+namespace {
+
+constexpr size_t kStageCount = static_cast<size_t>(MemoryStage::kCount);
+
+constexpr const char* kStageNames[kStageCount] = {"其他", "网络", "JSON解析", "标签", "数据库"};
+
+struct StageCounters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<int64_t> live{0};       // 未释放字节数（释放计入分配时的阶段，可能为负：跨阶段释放）
+    std::atomic<int64_t> peak_live{0};
+};
+
+StageCounters g_stages[kStageCount];
+std::atomic<uint64_t> g_peak_sampled_rss{0};
+
+thread_local MemoryStage t_stage = MemoryStage::kOther;
+
+// 每块分配前的头部，记录大小与阶段；16 字节保持默认对齐
+struct alignas(16) AllocationHeader {
+    size_t size;
+    MemoryStage stage;
+};
+
+static_assert(sizeof(AllocationHeader) == 16, "分配头部应为 16 字节");
+
+// 把一块分配计入当前阶段
+void track(AllocationHeader* header, size_t size) {
+    header->size = size;
+    header->stage = t_stage;
+    
+    StageCounters& counters = g_stages[static_cast<size_t>(header->stage)];
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    int64_t live = counters.live.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed) +
+                   static_cast<int64_t>(size);
+    int64_t peak = counters.peak_live.load(std::memory_order_relaxed);
+    while (live > peak && !counters.peak_live.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+// 从分配时的阶段扣除未释放字节数
+void untrack(const AllocationHeader* header) {
+    g_stages[static_cast<size_t>(header->stage)].live.fetch_sub(static_cast<int64_t>(header->size),
+                                                                std::memory_order_relaxed);
+}
+
+void* allocate(size_t size) {
+    void* block = std::malloc(sizeof(AllocationHeader) + size);
+    if (!block) {
+        return nullptr;
+    }
+    
+    auto* header = static_cast<AllocationHeader*>(block);
+    track(header, size);
+    return header + 1;
+}
+
+void deallocate(void* ptr) noexcept {
+    if (!ptr) {
+        return;
+    }
+    
+    auto* header = static_cast<AllocationHeader*>(ptr) - 1;
+    untrack(header);
+    std::free(header);
+}
+
+// 重新分配按一次释放加一次分配计数
+void* reallocate(void* ptr, size_t size) {
+    if (!ptr) {
+        return allocate(size);
+    }
+    
+    auto* header = static_cast<AllocationHeader*>(ptr) - 1;
+    AllocationHeader previous = *header;
+    void* block = std::realloc(header, sizeof(AllocationHeader) + size);
+    if (!block) {
+        return nullptr;
+    }
+    
+    untrack(&previous);
+    header = static_cast<AllocationHeader*>(block);
+    track(header, size);
+    return header + 1;
+}
+
+// curl_global_init_mem 的分配函数
+void* counted_malloc(size_t size) {
+    return allocate(size);
+}
+
+void counted_free(void* ptr) {
+    deallocate(ptr);
+}
+
+void* counted_realloc(void* ptr, size_t size) {
+    return reallocate(ptr, size);
+}
+
+char* counted_strdup(const char* str) {
+    size_t size = std::strlen(str) + 1;
+    void* copy = allocate(size);
+    if (copy) {
+        std::memcpy(copy, str, size);
+    }
+    return static_cast<char*>(copy);
+}
+
+void* counted_calloc(size_t count, size_t size) {
+    if (size != 0 && count > SIZE_MAX / size) {
+        return nullptr;
+    }
+    void* block = allocate(count * size);
+    if (block) {
+        std::memset(block, 0, count * size);
+    }
+    return block;
+}
+
+void* allocate_or_throw(size_t size) {
+    void* ptr = allocate(size == 0 ? 1 : size);
+    while (!ptr) {
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+        ptr = allocate(size == 0 ? 1 : size);
+    }
+    return ptr;
+}
+
+// 当前与峰值 RSS（字节），不支持的平台返回 0
+void read_rss(uint64_t& current, uint64_t& peak) {
+    current = 0;
+    peak = 0;
+
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        current = counters.WorkingSetSize;
+        peak = counters.PeakWorkingSetSize;
+    }
+#elif defined(__linux__)
+    if (FILE* file = std::fopen("/proc/self/statm", "r")) {
+        unsigned long long size = 0;
+        unsigned long long resident = 0;
+        if (std::fscanf(file, "%llu %llu", &size, &resident) == 2) {
+            current = resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        }
+        std::fclose(file);
+    }
+    if (FILE* file = std::fopen("/proc/self/status", "r")) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), file)) {
+            unsigned long long kb = 0;
+            if (std::sscanf(line, "VmHWM: %llu kB", &kb) == 1) {
+                peak = kb * 1024;
+                break;
+            }
+        }
+        std::fclose(file);
+    }
+#endif
+}
+
+double to_mb(double bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+MemoryStageScope::MemoryStageScope(MemoryStage stage) : previous_(t_stage) {
+    t_stage = stage;
+}
+
+MemoryStageScope::~MemoryStageScope() {
+    t_stage = previous_;
+}
+
+void MemoryStats::sample() {
+    uint64_t current = 0;
+    uint64_t peak = 0;
+    read_rss(current, peak);
+    
+    uint64_t sampled = g_peak_sampled_rss.load(std::memory_order_relaxed);
+    while (current > sampled && !g_peak_sampled_rss.compare_exchange_weak(sampled, current)) {
+    }
+}
+
+bool MemoryStats::init_curl() {
+    return curl_global_init_mem(CURL_GLOBAL_DEFAULT, counted_malloc, counted_free, counted_realloc, counted_strdup,
+                                counted_calloc) == CURLE_OK;
+}
+
+void MemoryStats::report() {
+    sample();
+    
+    uint64_t current = 0;
+    uint64_t peak = 0;
+    read_rss(current, peak);
+    
+    spdlog::info("=== 内存统计（各阶段含 C++ 与 curl 的分配）===");
+    for (size_t i = 0; i < kStageCount; ++i) {
+        const StageCounters& counters = g_stages[i];
+        spdlog::info("  {}: {} 次分配, 共 {:.1f} MB, 未释放 {:.1f} MB, 峰值 {:.1f} MB", kStageNames[i],
+                     counters.allocations.load(), to_mb(static_cast<double>(counters.bytes.load())),
+                     to_mb(static_cast<double>(counters.live.load())),
+                     to_mb(static_cast<double>(counters.peak_live.load())));
+    }
+    spdlog::info("  SQLite: 当前 {:.1f} MB, 峰值 {:.1f} MB（页缓存等，不计入上面各阶段）",
+                 to_mb(static_cast<double>(sqlite3_memory_used())),
+                 to_mb(static_cast<double>(sqlite3_memory_highwater(0))));
+    spdlog::info("  RSS: 当前 {:.1f} MB, 采样最大 {:.1f} MB, 峰值 {:.1f} MB", to_mb(static_cast<double>(current)),
+                 to_mb(static_cast<double>(g_peak_sampled_rss.load())), to_mb(static_cast<double>(peak)));
+}
+
+} // namespace pixiv2billfish
+
+// 全局分配函数：按当前阶段计数（对齐版本保持标准库默认实现）
+void* operator new(size_t size) {
+    return pixiv2billfish::allocate_or_throw(size);
+}
+
+void* operator new[](size_t size) {
+    return pixiv2billfish::allocate_or_throw(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return pixiv2billfish::allocate_or_throw(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return pixiv2billfish::allocate_or_throw(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void operator delete(void* ptr) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    pixiv2billfish::deallocate(ptr);
+}
+
+#endif // PIXIV2BILLFISH_MEMORY_STATS
@@ -0,0 +1,141 @@
+#include "note_template.h"
+
+namespace pixiv2billfish {
+
+namespace {
+
+constexpr std::string_view kFieldNames[NoteTemplate::kFieldCount] = {
+    "title", "artist", "uid", "bookmark", "comment", "pid", "origin"
+};
+
+std::optional<NoteTemplate::Field> find_field(std::string_view name) {
+    for (size_t i = 0; i < NoteTemplate::kFieldCount; ++i) {
+        if (kFieldNames[i] == name) {
+            return static_cast<NoteTemplate::Field>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+std::optional<NoteTemplate> NoteTemplate::compile(std::string_view source, std::string* error) {
+    auto fail = [error](std::string message) -> std::optional<NoteTemplate> {
+        if (error) {
+            *error = std::move(message);
+        }
+        return std::nullopt;
+    };
+    
+    NoteTemplate result;
+    std::vector<size_t> open_sections;  // 未闭合条件段对应的跳转指令下标
+    size_t literal_begin = 0;
+    
+    // 把自 literal_begin 起累积的字面量作为一条指令
+    auto flush_literal = [&result, &literal_begin]() {
+        if (result.literals_.size() > literal_begin) {
+            result.ops_.push_back({OpKind::kLiteral, kFieldCount, static_cast<uint32_t>(literal_begin),
+                                   static_cast<uint32_t>(result.literals_.size() - literal_begin)});
+        }
+        literal_begin = result.literals_.size();
+    };
+    
+    size_t pos = 0;
+    while (pos < source.size()) {
+        char c = source[pos];
+        if (c == '}' && pos + 1 < source.size() && source[pos + 1] == '}') {
+            result.literals_.push_back('}');
+            pos += 2;
+            continue;
+        }
+        if (c != '{') {
+            result.literals_.push_back(c);
+            ++pos;
+            continue;
+        }
+        if (pos + 1 < source.size() && source[pos + 1] == '{') {
+            result.literals_.push_back('{');
+            pos += 2;
+            continue;
+        }
+        
+        size_t close = source.find('}', pos + 1);
+        if (close == std::string_view::npos) {
+            return fail("位置 " + std::to_string(pos) + " 的 '{' 没有闭合");
+        }
+        std::string_view tag = source.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+        
+        char prefix = tag.empty() ? '\0' : tag.front();
+        bool has_prefix = prefix == '?' || prefix == '!' || prefix == '/';
+        std::string_view name = has_prefix ? tag.substr(1) : tag;
+        auto field = find_field(name);
+        if (!field) {
+            return fail("未知字段: {" + std::string(tag) + "}");
+        }
+        
+        flush_literal();
+        if (!has_prefix) {
+            result.ops_.push_back({OpKind::kField, *field, 0, 0});
+        } else if (prefix == '/') {
+            if (open_sections.empty() || result.ops_[open_sections.back()].field != *field) {
+                return fail("{/" + std::string(name) + "} 没有对应的开始标记");
+            }
+            result.ops_[open_sections.back()].begin = static_cast<uint32_t>(result.ops_.size());
+            open_sections.pop_back();
+        } else {
+            open_sections.push_back(result.ops_.size());
+            result.ops_.push_back({prefix == '?' ? OpKind::kSkipIfEmpty : OpKind::kSkipIfSet, *field, 0, 0});
+        }
+    }
+    
+    if (!open_sections.empty()) {
+        return fail("条件段 {" + std::string(kFieldNames[result.ops_[open_sections.back()].field]) + "} 没有闭合");
+    }
+    flush_literal();
+    
+    return result;
+}
+
+std::pmr::string NoteTemplate::render(const Values& values, std::pmr::memory_resource* resource) const {
+    // 长度上限：全部字面量加上每个字段引用，条件段被跳过时只会多预留
+    size_t capacity = literals_.size();
+    for (const Op& op : ops_) {
+        if (op.kind == OpKind::kField) {
+            capacity += values[op.field].size();
+        }
+    }
+    
+    std::pmr::string note(resource);
+    note.reserve(capacity);
+    
+    size_t pc = 0;
+    while (pc < ops_.size()) {
+        const Op& op = ops_[pc];
+        switch (op.kind) {
+        case OpKind::kLiteral:
+            note.append(literals_, op.begin, op.size);
+            break;
+        case OpKind::kField:
+            note.append(values[op.field]);
+            break;
+        case OpKind::kSkipIfEmpty:
+            if (values[op.field].empty()) {
+                pc = op.begin;
+                continue;
+            }
+            break;
+        case OpKind::kSkipIfSet:
+            if (!values[op.field].empty()) {
+                pc = op.begin;
+                continue;
+            }
+            break;
+        }
+        ++pc;
+    }
+    
+    return note;
+}
+
+} // namespace pixiv2billfish
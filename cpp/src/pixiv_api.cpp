@@ -1,15 +1,154 @@
 #include "pixiv_api.h"
+#include "arena.h"
+#include "memory_stats.h"
+#include "trace.h"
 #include <nlohmann/json.hpp>
 #include <spdlog/spdlog.h>
-#include <regex>
 #include <thread>
 #include <chrono>
+#include <charconv>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 
-using json = nlohmann::json;
+namespace {
+
+// 解析用的JSON DOM，节点与字符串都从当前线程的 TaskArena 分配
+using ArenaString = std::basic_string<char, std::char_traits<char>, pixiv2billfish::ArenaAllocator<char>>;
+using json = nlohmann::basic_json<std::map, std::vector, ArenaString, bool,
+                                  std::int64_t, std::uint64_t, double,
+                                  pixiv2billfish::ArenaAllocator>;
+
+// 作者批量接口单次最多查询的作品数
+constexpr size_t kUserIllustsBatchSize = 48;
+
+// 读取字符串字段（不拷贝），类型不符时抛出 json::type_error
+std::string_view text(const json& value) {
+    return value.get_ref<const ArenaString&>();
+}
+
+// 不区分大小写地检查 text 是否以 prefix 开头
+bool starts_with_icase(std::string_view text, std::string_view prefix) {
+    if (text.size() < prefix.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < prefix.size(); ++i) {
+        if (std::tolower(static_cast<unsigned char>(text[i])) != prefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 4字节按小端读成整数（扩展名比较用）
+constexpr uint32_t make_word(const char* bytes) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(bytes[0])) |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[1])) << 8 |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[2])) << 16 |
+           static_cast<uint32_t>(static_cast<unsigned char>(bytes[3])) << 24;
+}
+
+uint32_t tail_word(std::string_view name) {
+    uint32_t value;
+    std::memcpy(&value, name.data() + name.size() - 4, 4);
+    return value;
+}
+
+// 与 PixivAPI::extract_pid 的扩展名列表一致：末尾4字节一次读出，与各扩展名按整数比较，
+// 分支少，扩展名混杂时也不易预测失败
+bool has_pixiv_extension(std::string_view name) {
+    if (name.size() < 4) {
+        return false;
+    }
+    uint32_t tail = tail_word(name);
+    if (tail == make_word(".lnk")) {
+        name.remove_suffix(4);
+        if (name.size() < 4) {
+            return false;
+        }
+        tail = tail_word(name);
+    }
+    
+    // 3字节扩展名取高3字节比较，文件名须比扩展名长
+    uint32_t tail3 = tail >> 8;
+    bool short_ext = (tail3 == make_word(".jpg") >> 8) | (tail3 == make_word(".png") >> 8) |
+                     (tail3 == make_word(".gif") >> 8) | (tail3 == make_word(".zip") >> 8);
+    bool long_ext = ((tail == make_word("webp")) | (tail == make_word("webm"))) & (name.size() > 4);
+    return short_ext | long_ext;
+}
+
+// 解析整个十进制数字串，失败、溢出或为0时返回0
+uint64_t parse_pid(std::string_view digits) {
+    uint64_t pid = 0;
+    auto result = std::from_chars(digits.data(), digits.data() + digits.size(), pid);
+    if (result.ec != std::errc() || result.ptr != digits.data() + digits.size()) {
+        return 0;
+    }
+    return pid;
+}
+
+// 在 out 末尾追加十进制PID
+void append_pid(std::string& out, uint64_t pid) {
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), pid);
+    out.append(digits, result.ptr);
+}
+
+// 每个线程复用的插画接口URL缓冲区
+thread_local std::string illust_url_buffer;
+
+// PID是开头的数字串，紧跟的分隔符必须是 extract_pid 会选中的那个：
+// 有 '-' 时取第一个 '-'，否则第一个 '_'，否则第一个 '.'
+uint64_t classify_name(std::string_view name) {
+    if (!has_pixiv_extension(name)) {
+        return 0;
+    }
+    
+    // from_chars 停在第一个非数字字符上，溢出时报错
+    uint64_t pid = 0;
+    auto result = std::from_chars(name.data(), name.data() + name.size(), pid);
+    size_t end = static_cast<size_t>(result.ptr - name.data());
+    if (result.ec != std::errc() || pid == 0 || end >= name.size()) {
+        return 0;
+    }
+    
+    // 数字串中不会有分隔符，只需检查其后的部分
+    const char* rest = name.data() + end;
+    size_t rest_size = name.size() - end;
+    switch (*rest) {
+    case '-':
+        return pid;
+    case '_':
+        return std::memchr(rest, '-', rest_size) ? 0 : pid;
+    case '.':
+        return std::memchr(rest, '-', rest_size) || std::memchr(rest, '_', rest_size) ? 0 : pid;
+    default:
+        return 0;
+    }
+}
+
+// 编译配置的备注模板，为空或有语法错误时使用默认模板
+pixiv2billfish::NoteTemplate compile_note_template(const std::string& source) {
+    using pixiv2billfish::NoteTemplate;
+    
+    if (!source.empty()) {
+        std::string error;
+        if (auto compiled = NoteTemplate::compile(source, &error)) {
+            return std::move(*compiled);
+        }
+        spdlog::error("备注模板无效，使用默认模板: {}", error);
+    }
+    return *NoteTemplate::compile(NoteTemplate::kDefault);
+}
+
+} // namespace
 
 namespace pixiv2billfish {
 
-PixivAPI::PixivAPI(const Config& config) : config_(config) {
+PixivAPI::PixivAPI(const Config& config)
+    : config_(config), rate_limiter_(config.max_requests_per_second),
+      note_template_(compile_note_template(config.note_template)),
+      request_delay_ms_(config.request_delay_ms), retry_count_(config.retry_count) {
     http_client_.set_timeout(config.request_timeout);
     http_client_.set_headers(config.headers);
     
@@ -18,9 +157,42 @@ PixivAPI::PixivAPI(const Config& config) : config_(config) {
     }
 }
 
-std::optional<std::string> PixivAPI::extract_pid(const std::string& filename) {
+void PixivAPI::apply_runtime_config(const Config& previous, const Config& updated) {
+    if (updated.max_requests_per_second != previous.max_requests_per_second) {
+        rate_limiter_.set_rate(updated.max_requests_per_second);
+        spdlog::info("请求速率上限: {} -> {} 次/秒", previous.max_requests_per_second, updated.max_requests_per_second);
+    }
+    if (updated.request_delay_ms != previous.request_delay_ms) {
+        request_delay_ms_ = updated.request_delay_ms;
+        spdlog::info("请求间隔: {} -> {} 毫秒", previous.request_delay_ms, updated.request_delay_ms);
+    }
+    if (updated.retry_count != previous.retry_count) {
+        retry_count_ = updated.retry_count;
+        spdlog::info("重试次数: {} -> {}", previous.retry_count, updated.retry_count);
+    }
+    if (updated.request_timeout != previous.request_timeout) {
+        http_client_.set_timeout(updated.request_timeout);
+        spdlog::info("请求超时: {} -> {} 秒", previous.request_timeout, updated.request_timeout);
+    }
+    if (updated.headers != previous.headers) {
+        http_client_.set_headers(updated.headers);
+        spdlog::info("请求头已更新: {} 项", updated.headers.size());
+    }
+    if (updated.use_proxies != previous.use_proxies || updated.http_proxy != previous.http_proxy ||
+        updated.https_proxy != previous.https_proxy) {
+        if (updated.use_proxies) {
+            http_client_.set_proxy(updated.http_proxy, updated.https_proxy);
+            spdlog::info("代理: {}", updated.http_proxy);
+        } else {
+            http_client_.set_proxy("", "");
+            spdlog::info("代理: 不使用");
+        }
+    }
+}
+
+std::optional<Pid> PixivAPI::extract_pid(std::string_view filename) {
     // 支持的扩展名
-    static const std::vector<std::string> extensions = {
+    static constexpr std::string_view extensions[] = {
         "jpg", "png", "gif", "webp", "webm", "zip",
         "jpg.lnk", "png.lnk", "gif.lnk", "webp.lnk", "webm.lnk", "zip.lnk"
     };
@@ -40,17 +212,17 @@ std::optional<std::string> PixivAPI::extract_pid(const std::string& filename) {
     }
     
     // 提取PID
-    std::string pid;
+    std::string_view pid;
     
     size_t dash_pos = filename.find('-');
     size_t underscore_pos = filename.find('_');
     size_t dot_pos = filename.find('.');
     
-    if (dash_pos != std::string::npos) {
+    if (dash_pos != std::string_view::npos) {
         pid = filename.substr(0, dash_pos);
-    } else if (underscore_pos != std::string::npos) {
+    } else if (underscore_pos != std::string_view::npos) {
         pid = filename.substr(0, underscore_pos);
-    } else if (dot_pos != std::string::npos) {
+    } else if (dot_pos != std::string_view::npos) {
         pid = filename.substr(0, dot_pos);
     } else {
         return std::nullopt;
@@ -61,21 +233,37 @@ std::optional<std::string> PixivAPI::extract_pid(const std::string& filename) {
         return std::nullopt;
     }
     
-    return pid;
+    Pid value = parse_pid(pid);
+    if (value == 0) {
+        return std::nullopt;
+    }
+    return value;
 }
 
-std::string PixivAPI::process_artist_name(const std::string& artist) {
-    std::string result = artist;
+void PixivAPI::extract_pids(const std::string_view* names, size_t count, Pid* pids) {
+    for (size_t i = 0; i < count; ++i) {
+        pids[i] = classify_name(names[i]);
+    }
+}
+
+std::string_view PixivAPI::format_pid_url(std::string_view prefix, Pid pid, std::string& buffer) {
+    buffer.assign(prefix);
+    append_pid(buffer, pid);
+    return buffer;
+}
+
+std::string_view PixivAPI::process_artist_name(std::string_view artist) {
+    std::string_view result = artist;
     
     // 移除@后面的内容
     size_t at_pos = result.rfind('@');
-    if (at_pos != std::string::npos && at_pos >= 2 && at_pos <= result.size() - 3) {
+    if (at_pos != std::string_view::npos && at_pos >= 2 && at_pos <= result.size() - 3) {
         result = result.substr(0, at_pos);
     }
     
     // 移除全角@后面的内容
     size_t fullwidth_at_pos = result.rfind('＠');
-    if (fullwidth_at_pos != std::string::npos && 
+    if (fullwidth_at_pos != std::string_view::npos && 
         fullwidth_at_pos >= 2 && fullwidth_at_pos <= result.size() - 3) {
         result = result.substr(0, fullwidth_at_pos);
     }
@@ -83,79 +271,389 @@ std::string PixivAPI::process_artist_name(const std::string& artist) {
     return result;
 }
 
-std::string PixivAPI::clean_html(const std::string& html) {
-    std::string result = html;
+std::pmr::string PixivAPI::clean_html(std::string_view html) {
+    std::pmr::string result(current_resource());
+    result.reserve(html.size());
     
-    // 替换<br />为换行
-    std::regex br_regex("<br\\s*/?>", std::regex::icase);
-    result = std::regex_replace(result, br_regex, "\r\n");
+    size_t pos = 0;
+    while (pos < html.size()) {
+        size_t open = html.find('<', pos);
+        result.append(html.substr(pos, open - pos));
+        if (open == std::string_view::npos) {
+            break;
+        }
+        
+        size_t close = html.find('>', open + 1);
+        if (close == std::string_view::npos || close == open + 1) {
+            // 不构成标签，原样保留
+            result.push_back('<');
+            pos = open + 1;
+            continue;
+        }
+        
+        std::string_view tag = html.substr(open + 1, close - open - 1);
+        pos = close + 1;
+        
+        // 替换<br />为换行
+        if (starts_with_icase(tag, "br")) {
+            size_t i = 2;
+            while (i < tag.size() && std::isspace(static_cast<unsigned char>(tag[i]))) ++i;
+            if (i < tag.size() && tag[i] == '/') ++i;
+            if (i == tag.size()) {
+                result.append("\r\n");
+                continue;
+            }
+        }
+        
+        // 处理链接：<a href="..."> 转为 [url]...[/url]，站内jump.php跳转链接直接移除
+        if (starts_with_icase(tag, "a") && tag.size() > 1 &&
+            std::isspace(static_cast<unsigned char>(tag[1]))) {
+            size_t i = 1;
+            while (i < tag.size() && std::isspace(static_cast<unsigned char>(tag[i]))) ++i;
+            std::string_view rest = tag.substr(i);
+            if (starts_with_icase(rest, "href=\"")) {
+                size_t end = rest.find('"', 6);
+                if (end != std::string_view::npos && end > 6) {
+                    std::string_view href = rest.substr(6, end - 6);
+                    bool is_jump = href.substr(0, 9) == "/jump.php" &&
+                                   href.find(']') == std::string_view::npos;
+                    if (!is_jump) {
+                        result.append("[url]").append(href).append("[/url]\r\n");
+                    }
+                    continue;
+                }
+            }
+        }
+        
+        // 移除其他HTML标签
+    }
     
-    // 处理链接
-    std::regex link_regex("<a\\s+href=\"([^\"]+)\"[^>]*>", std::regex::icase);
-    result = std::regex_replace(result, link_regex, "[url]$1[/url]\r\n");
+    return result;
+}
+
+void PixivAPI::insert_cache_locked(Pid pid, IllustFuture future) {
+    auto it = cache_.find(pid);
+    if (it != cache_.end()) {
+        it->second.future = std::move(future);
+        return;
+    }
+    cache_order_.push_back(pid);
+    cache_.emplace(pid, CacheEntry{std::move(future), std::prev(cache_order_.end())});
     
-    // 移除其他HTML标签
-    std::regex tag_regex("<[^>]+>");
-    result = std::regex_replace(result, tag_regex, "");
+    // 按插入顺序淘汰最旧的条目
+    size_t capacity = static_cast<size_t>(std::max(config_.metadata_cache_size, 1));
+    while (cache_order_.size() > capacity) {
+        cache_.erase(cache_order_.front());
+        cache_order_.pop_front();
+    }
+}
+
+void PixivAPI::erase_cache_locked(Pid pid) {
+    auto it = cache_.find(pid);
+    if (it != cache_.end()) {
+        cache_order_.erase(it->second.order);
+        cache_.erase(it);
+    }
+}
+
+std::shared_ptr<const IllustData> PixivAPI::get_illust(Pid pid, bool allow_partial) {
+    std::promise<std::shared_ptr<const IllustData>> promise;
     
-    // 移除jump.php链接
-    std::regex jump_regex("\\[url\\]/jump\\.php[^\\]]*\\[/url\\]\\r\\n");
-    result = std::regex_replace(result, jump_regex, "");
+    std::unique_lock<std::mutex> lock(cache_mutex_);
     
-    return result;
+    // 占位的请求失败时（例如批量接口没有返回该作品）按未命中处理，重新查找一次；
+    // 失败的占位在设置结果前已移除，重新查找时要么由本线程请求，要么等待其他线程的新请求
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto it = cache_.find(pid);
+        if (it == cache_.end()) {
+            break;
+        }
+        
+        // 可能是其他线程（或其他图库）正在进行的请求，等待其结果
+        IllustFuture future = it->second.future;
+        lock.unlock();
+        auto cached = future.get();
+        
+        if (cached && (!cached->partial || allow_partial)) {
+            cache_hits_++;
+            return cached;
+        }
+        
+        if (cached) {
+            // 缓存中只有批量接口的部分数据，请求完整数据并替换
+            auto data = fetch_illust(pid);
+            if (data) {
+                promise.set_value(data);
+                lock.lock();
+                insert_cache_locked(pid, promise.get_future().share());
+            }
+            return data;
+        }
+        
+        if (attempt == 1) {
+            return nullptr;
+        }
+        lock.lock();
+    }
+    
+    insert_cache_locked(pid, promise.get_future().share());
+    bool expand_user = config_.batch_user_fetch && !batch_candidates_.empty();
+    
+    lock.unlock();
+    
+    std::shared_ptr<const IllustData> data;
+    try {
+        data = fetch_illust(pid);
+    } catch (...) {
+        // 等待中的线程按请求失败处理
+        lock.lock();
+        erase_cache_locked(pid);
+        lock.unlock();
+        promise.set_value(nullptr);
+        throw;
+    }
+    
+    // 失败的结果不缓存，以便之后重试
+    if (!data) {
+        lock.lock();
+        erase_cache_locked(pid);
+        lock.unlock();
+        promise.set_value(nullptr);
+        return data;
+    }
+    promise.set_value(data);
+    
+    if (expand_user && !data->info.user_id.empty()) {
+        prefetch_user_works(std::string(data->info.user_id));
+    }
+    
+    return data;
+}
+
+void PixivAPI::add_batch_candidates(const std::vector<Pid>& pids) {
+    std::lock_guard<std::mutex> lock(cache_mutex_);
+    batch_candidates_.insert(pids.begin(), pids.end());
+}
+
+std::optional<HttpResponse> PixivAPI::fetch_user_endpoint(std::string_view url) {
+    {
+        TraceSpan trace("wait", "throttle");
+        if (int delay_ms = request_delay_ms_.load(); delay_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+        rate_limiter_.acquire();
+    }
+    batch_request_count_++;
+    
+    auto response = http_client_.get(url, retry_count_.load());
+    if (!response || !response->success || response->status_code != 200) {
+        spdlog::warn("作者接口请求失败: {}", url);
+        return std::nullopt;
+    }
+    return response;
+}
+
+void PixivAPI::prefetch_user_works(const std::string& user_id) {
+    // 每位作者只展开一次
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        if (!batch_users_.insert(user_id).second) {
+            return;
+        }
+    }
+    
+    // 作者的全部作品ID
+    std::string url = config_.pixiv_user_api_url + user_id + "/profile/all";
+    auto response = fetch_user_endpoint(url);
+    if (!response) {
+        return;
+    }
+    
+    std::vector<Pid> work_ids;
+    try {
+        json j = json::parse(response->body);
+        const auto& body = j.at("body");
+        for (const char* category : {"illusts", "manga"}) {
+            auto works = body.find(category);
+            if (works != body.end() && works->is_object()) {
+                for (const auto& work : works->items()) {
+                    if (Pid id = parse_pid(work.key())) {
+                        work_ids.push_back(id);
+                    }
+                }
+            }
+        }
+    } catch (const json::exception& e) {
+        spdlog::warn("解析作者作品列表失败 UID={}: {}", user_id, e.what());
+        return;
+    }
+    HttpClient::recycle_buffer(std::move(response->body));
+    
+    // 候选中尚未缓存的作品：先占位，避免其他线程重复请求
+    std::vector<Pid> pids;
+    std::vector<std::promise<std::shared_ptr<const IllustData>>> promises;
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex_);
+        for (Pid id : work_ids) {
+            if (batch_candidates_.count(id) == 0 || cache_.count(id) > 0) {
+                continue;
+            }
+            promises.emplace_back();
+            insert_cache_locked(id, promises.back().get_future().share());
+            pids.push_back(id);
+        }
+    }
+    
+    if (pids.empty()) {
+        return;
+    }
+    
+    spdlog::debug("作者 UID={}: 批量预取 {} 个作品", user_id, pids.size());
+    
+    // 出现异常时，尚未设置的占位按请求失败处理，避免等待中的线程收到 broken_promise
+    size_t settled = 0;
+    try {
+        for (size_t begin = 0; begin < pids.size(); begin += kUserIllustsBatchSize) {
+            size_t end = std::min(pids.size(), begin + kUserIllustsBatchSize);
+            
+            std::string batch_url = config_.pixiv_user_api_url + user_id + "/profile/illusts?";
+            for (size_t i = begin; i < end; ++i) {
+                batch_url.append("ids%5B%5D=");
+                append_pid(batch_url, pids[i]);
+                batch_url.append("&");
+            }
+            batch_url.append("work_category=illustManga&is_first_page=0");
+            
+            std::unordered_map<Pid, std::shared_ptr<const IllustData>> works;
+            if (auto batch = fetch_user_endpoint(batch_url)) {
+                parse_user_illusts(batch->body, works);
+                HttpClient::recycle_buffer(std::move(batch->body));
+            }
+            
+            // 批量接口没有返回的作品留给单个接口：先移除占位再设置结果，
+            // 等待中的线程收到空结果后重新查找时不会再命中失败的占位
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex_);
+                for (size_t i = begin; i < end; ++i) {
+                    if (works.count(pids[i]) == 0) {
+                        erase_cache_locked(pids[i]);
+                    }
+                }
+            }
+            for (size_t i = begin; i < end; ++i) {
+                auto work = works.find(pids[i]);
+                if (work != works.end()) {
+                    promises[i].set_value(work->second);
+                    batch_prefetch_count_++;
+                } else {
+                    promises[i].set_value(nullptr);
+                }
+                settled = i + 1;
+            }
+        }
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(cache_mutex_);
+            for (size_t i = settled; i < pids.size(); ++i) {
+                erase_cache_locked(pids[i]);
+            }
+        }
+        for (size_t i = settled; i < pids.size(); ++i) {
+            promises[i].set_value(nullptr);
+        }
+        throw;
+    }
 }
 
-std::optional<std::vector<std::string>> PixivAPI::get_tags(const std::string& pid) {
-    std::string url = config_.pixiv_api_url + pid;
+std::shared_ptr<const IllustData> PixivAPI::fetch_illust(Pid pid) {
+    std::string_view url = format_pid_url(config_.pixiv_api_url, pid, illust_url_buffer);
     
-    // 请求延迟
-    if (config_.request_delay_ms > 0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(config_.request_delay_ms));
+    {
+        TraceSpan trace("wait", "throttle", "pid", static_cast<int64_t>(pid));
+        
+        // 请求延迟
+        if (int delay_ms = request_delay_ms_.load(); delay_ms > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+        }
+        
+        // 全局限速
+        rate_limiter_.acquire();
     }
+    request_count_++;
     
-    auto response = http_client_.get(url, config_.retry_count);
+    auto response = http_client_.get(url, retry_count_.load());
     
     if (!response || !response->success) {
-        spdlog::warn("获取标签失败 PID={}", pid);
-        return std::nullopt;
+        spdlog::warn("获取插画信息失败 PID={}", pid);
+        return nullptr;
     }
     
     if (response->status_code == 404) {
         spdlog::warn("PID={} 返回404", pid);
-        return std::vector<std::string>{"Error:404"};
+        auto data = std::make_shared<IllustData>();
+        data->tags.push_back(TagTable::global().intern("Error:404"));
+        data->info.comment = "Error:404";
+        return data;
     }
     
+    auto data = parse_illust(response->body, pid);
+    HttpClient::recycle_buffer(std::move(response->body));
+    
+    if (!data) {
+        return nullptr;
+    }
+    return std::make_shared<IllustData>(std::move(*data));
+}
+
+std::optional<IllustData> PixivAPI::parse_illust(std::string_view body, Pid pid) {
+    MemoryStageScope memory_stage(MemoryStage::kJson);
+    TraceSpan trace("json", "parse_illust", "pid", static_cast<int64_t>(pid));
     try {
-        json j = json::parse(response->body);
+        json j = json::parse(body);
         
         if (j["error"].get<bool>()) {
-            spdlog::warn("API返回错误 PID={}: {}", pid, j["message"].get<std::string>());
+            spdlog::warn("API返回错误 PID={}: {}", pid, text(j["message"]));
             return std::nullopt;
         }
         
-        std::vector<std::string> tag_list;
+        const auto& illust = j["body"];
+        const auto& tags = illust.at("tags").at("tags");
+        TagTable& table = TagTable::global();
+        
+        // 结果会进入缓存，使用全局堆而非任务内存池
+        IllustData data;
+        data.tags.reserve(tags.size() * 2 + 1);
         
         // 添加艺术家名称
-        std::string artist = j["body"]["userName"].get<std::string>();
-        artist = process_artist_name(artist);
-        tag_list.push_back("Artist:" + artist);
+        std::string_view artist = process_artist_name(text(illust.at("userName")));
+        std::pmr::string artist_tag(current_resource());
+        artist_tag.reserve(7 + artist.size());
+        artist_tag.append("Artist:").append(artist);
+        data.tags.push_back(table.intern(artist_tag));
         
         // 添加标签
-        auto tags = j["body"]["tags"]["tags"];
         for (const auto& tag : tags) {
             // 添加英文翻译
-            if (tag.contains("translation") && tag["translation"].contains("en")) {
-                tag_list.push_back(tag["translation"]["en"].get<std::string>());
+            auto translation = tag.find("translation");
+            if (translation != tag.end() && translation->contains("en")) {
+                data.tags.push_back(table.intern(text((*translation)["en"])));
             }
             // 添加原始标签
-            tag_list.push_back(tag["tag"].get<std::string>());
+            data.tags.push_back(table.intern(text(tag.at("tag"))));
         }
         
-        // 去重
-        std::sort(tag_list.begin(), tag_list.end());
-        tag_list.erase(std::unique(tag_list.begin(), tag_list.end()), tag_list.end());
+        // 按句柄去重
+        std::sort(data.tags.begin(), data.tags.end());
+        data.tags.erase(std::unique(data.tags.begin(), data.tags.end()), data.tags.end());
         
-        return tag_list;
+        // 备注信息
+        data.info.title = text(illust.at("illustTitle"));
+        data.info.artist = artist;
+        data.info.user_id = text(illust.at("userId"));
+        data.info.bookmark_count = illust.at("bookmarkCount").get<int>();
+        data.info.comment = clean_html(text(illust.at("illustComment")));
+        
+        return data;
         
     } catch (const json::exception& e) {
         spdlog::error("解析JSON失败 PID={}: {}", pid, e.what());
@@ -163,75 +661,73 @@ std::optional<std::vector<std::string>> PixivAPI::get_tags(const std::string& pi
     }
 }
 
-std::optional<IllustInfo> PixivAPI::get_illust_info(const std::string& pid) {
-    std::string url = config_.pixiv_api_url + pid;
-    
-    // 请求延迟
-    if (config_.request_delay_ms > 0) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(config_.request_delay_ms));
-    }
-    
-    auto response = http_client_.get(url, config_.retry_count);
-    
-    if (!response || !response->success) {
-        spdlog::warn("获取插画信息失败 PID={}", pid);
-        return std::nullopt;
-    }
-    
-    if (response->status_code == 404) {
-        spdlog::warn("PID={} 返回404", pid);
-        IllustInfo info;
-        info.comment = "Error:404";
-        return info;
-    }
-    
+bool PixivAPI::parse_user_illusts(std::string_view body,
+                                  std::unordered_map<Pid, std::shared_ptr<const IllustData>>& works) {
+    MemoryStageScope memory_stage(MemoryStage::kJson);
+    TraceSpan trace("json", "parse_user_illusts");
     try {
-        json j = json::parse(response->body);
+        json j = json::parse(body);
         
         if (j["error"].get<bool>()) {
-            spdlog::warn("API返回错误 PID={}: {}", pid, j["message"].get<std::string>());
-            return std::nullopt;
+            spdlog::warn("作者接口返回错误: {}", text(j["message"]));
+            return false;
         }
         
-        IllustInfo info;
-        info.title = j["body"]["illustTitle"].get<std::string>();
-        info.artist = process_artist_name(j["body"]["userName"].get<std::string>());
-        info.user_id = j["body"]["userId"].get<std::string>();
-        info.bookmark_count = j["body"]["bookmarkCount"].get<int>();
+        TagTable& table = TagTable::global();
         
-        std::string raw_comment = j["body"]["illustComment"].get<std::string>();
-        info.comment = clean_html(raw_comment);
+        for (const auto& [id, work] : j.at("body").at("works").items()) {
+            auto data = std::make_shared<IllustData>();
+            data->partial = true;
+            
+            std::string_view artist = process_artist_name(text(work.at("userName")));
+            std::pmr::string artist_tag(current_resource());
+            artist_tag.reserve(7 + artist.size());
+            artist_tag.append("Artist:").append(artist);
+            
+            const auto& tags = work.at("tags");
+            data->tags.reserve(tags.size() + 1);
+            data->tags.push_back(table.intern(artist_tag));
+            for (const auto& tag : tags) {
+                data->tags.push_back(table.intern(text(tag)));
+            }
+            
+            // 按句柄去重
+            std::sort(data->tags.begin(), data->tags.end());
+            data->tags.erase(std::unique(data->tags.begin(), data->tags.end()), data->tags.end());
+            
+            data->info.title = text(work.at("title"));
+            data->info.artist = artist;
+            data->info.user_id = text(work.at("userId"));
+            
+            if (Pid pid = parse_pid(id)) {
+                works.emplace(pid, std::move(data));
+            }
+        }
         
-        return info;
+        return true;
         
     } catch (const json::exception& e) {
-        spdlog::error("解析JSON失败 PID={}: {}", pid, e.what());
-        return std::nullopt;
+        spdlog::error("解析作者作品失败: {}", e.what());
+        return false;
     }
 }
 
-std::string PixivAPI::format_note(const IllustInfo& info) {
-    std::string note;
-    
-    note += "Title:" + info.title + "\r\n";
-    note += "Artist:" + info.artist + "\r\n";
-    note += "UID:" + info.user_id + "\r\n";
-    note += "Bookmark:" + std::to_string(info.bookmark_count) + "\r\n";
+std::pmr::string PixivAPI::format_note(const IllustInfo& info, Pid pid, std::string_view origin) const {
+    char bookmark[16];
+    auto bookmark_end = std::to_chars(bookmark, bookmark + sizeof(bookmark), info.bookmark_count).ptr;
+    char pid_text[24];
+    auto pid_end = std::to_chars(pid_text, pid_text + sizeof(pid_text), pid).ptr;
     
-    if (!info.comment.empty()) {
-        note += "Comment:\r\n" + info.comment;
-    } else {
-        note += "No Comment\r\n";
-    }
-    
-    // 转义单引号
-    size_t pos = 0;
-    while ((pos = note.find('\'', pos)) != std::string::npos) {
-        note.replace(pos, 1, "''");
-        pos += 2;
-    }
+    NoteTemplate::Values values;
+    values[NoteTemplate::kTitle] = info.title;
+    values[NoteTemplate::kArtist] = info.artist;
+    values[NoteTemplate::kUid] = info.user_id;
+    values[NoteTemplate::kBookmark] = std::string_view(bookmark, bookmark_end - bookmark);
+    values[NoteTemplate::kComment] = info.comment;
+    values[NoteTemplate::kPid] = std::string_view(pid_text, pid_end - pid_text);
+    values[NoteTemplate::kOrigin] = origin;
     
-    return note;
+    return note_template_.render(values, current_resource());
 }
 
 } // namespace pixiv2billfish
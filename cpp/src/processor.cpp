@@ -1,10 +1,58 @@
 #include "processor.h"
+#include "arena.h"
+#include "memory_stats.h"
+#include "trace.h"
 #include <spdlog/spdlog.h>
 #include <algorithm>
 #include <chrono>
+#include <thread>
 
 namespace pixiv2billfish {
 
+namespace {
+
+// 作者标签前缀（PixivAPI 生成 "Artist:<作者名>"）
+constexpr std::string_view kArtistPrefix = "Artist:";
+
+// 同一文件连续失败多少次后放弃重试（已删除或设为私密的作品永远请求失败）
+constexpr int kMaxRetryAttempts = 5;
+
+// 每个线程复用的作品页URL缓冲区（备注的 origin 列）
+thread_local std::string origin_buffer;
+
+// 分片键：优先使用PID（同一作品的文件落在同一分片，共享元数据缓存），无法提取时使用文件ID
+uint64_t shard_key(int64_t file_id, Pid pid) {
+    uint64_t key = pid != 0 ? pid : static_cast<uint64_t>(file_id);
+    
+    // splitmix64 混合，保证分布均匀且与平台、版本无关
+    key += 0x9e3779b97f4a7c15ULL;
+    key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+    return key ^ (key >> 31);
+}
+
+// 在只读连接上异步执行查询：有只读连接池时直接使用，否则临时打开一个；打开失败时退回主连接
+template<typename Query>
+auto read_async(Database& db, Query query) {
+    return std::async(std::launch::async, [&db, query] {
+        MemoryStageScope memory_stage(MemoryStage::kDatabase);
+        if (db.has_read_pool()) {
+            return query(db);
+        }
+        Database reader(db.path());
+        return reader.open_read_only() ? query(reader) : query(db);
+    });
+}
+
+} // namespace
+
+void Statistics::reset() {
+    total_count = 0;
+    success_count = 0;
+    fail_count = 0;
+    skip_count = 0;
+}
+
 void Statistics::print(const std::string& prefix) const {
     spdlog::info("=== {} 统计 ===", prefix);
     spdlog::info("  总数: {}", total_count.load());
@@ -13,8 +61,16 @@ void Statistics::print(const std::string& prefix) const {
     spdlog::info("  跳过: {}", skip_count.load());
 }
 
-Processor::Processor(const Config& config, Database& db)
-    : config_(config), db_(db), is_v3_db_(false) {
+Processor::Processor(const Config& config, Database& db, std::shared_ptr<PixivAPI> api)
+    : config_(config), db_(db), is_v3_db_(false), pixiv_api_(std::move(api)),
+      tag_thread_count_(config.tag_thread_count), note_thread_count_(config.note_thread_count),
+      tag_batch_(config.batch_size_tag, std::chrono::milliseconds(config.target_commit_ms),
+                 std::chrono::milliseconds(config.max_write_lag_ms)),
+      tag_join_batch_(config.batch_size_tag_join, std::chrono::milliseconds(config.target_commit_ms),
+                      std::chrono::milliseconds(config.max_write_lag_ms)),
+      note_batch_(config.batch_size_note, std::chrono::milliseconds(config.target_commit_ms),
+                  std::chrono::milliseconds(config.max_write_lag_ms)),
+      max_write_lag_ms_(config.max_write_lag_ms) {
 }
 
 Processor::~Processor() = default;
@@ -25,50 +81,118 @@ bool Processor::initialize() {
     spdlog::info("数据库版本: {}", is_v3_db_ ? "3.0+" : "2.x");
     
     // 创建API客户端
-    pixiv_api_ = std::make_unique<PixivAPI>(config_);
+    if (!pixiv_api_) {
+        pixiv_api_ = std::make_shared<PixivAPI>(config_);
+    }
     
-    // 创建线程池
-    if (config_.write_tag) {
-        tag_pool_ = std::make_unique<ThreadPool>(config_.tag_thread_count);
-        spdlog::info("标签线程池已创建: {} 线程", config_.tag_thread_count);
+    // 创建线程池（线程数可能已被重新加载的配置修改）
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        
+        if (config_.write_tag) {
+            tag_pool_ = std::make_unique<ThreadPool>(tag_thread_count_);
+            spdlog::info("标签线程池已创建: {} 线程", tag_thread_count_);
+        }
+        
+        if (config_.write_note) {
+            note_pool_ = std::make_unique<ThreadPool>(note_thread_count_);
+            spdlog::info("备注线程池已创建: {} 线程", note_thread_count_);
+        }
     }
     
-    if (config_.write_note) {
-        note_pool_ = std::make_unique<ThreadPool>(config_.note_thread_count);
-        spdlog::info("备注线程池已创建: {} 线程", config_.note_thread_count);
+    // 分片模式：结果写入暂存文件，由合并步骤统一写库（抓取模式已指定元数据包）
+    if (config_.sharded() && !staging_) {
+        staging_ = std::make_unique<BundleWriter>(config_.staging_path());
+        if (!staging_->open()) {
+            return false;
+        }
+        spdlog::info("分片 {}/{}: 结果写入暂存文件 {}",
+                     config_.shard_index, config_.shard_count, staging_->path());
+    }
+    
+    if (config_.batch_user_fetch && config_.write_note) {
+        spdlog::warn("作者批量预取只在仅写入标签 (write_note=false) 时生效");
     }
     
     // 加载缓存
     load_cache();
     
+    // Artist标签层级（分片与抓取模式不写数据库，由应用步骤处理）
+    if (is_v3_db_ && config_.write_tag && !staging_) {
+        resolve_artist_tags();
+    }
+    
     return true;
 }
 
 void Processor::load_cache() {
     spdlog::info("正在加载缓存数据...");
+    auto start_time = std::chrono::steady_clock::now();
+    
+    // 三个扫描互不依赖，各自在独立的只读连接上并发执行，启动耗时取决于最慢的一个
+    auto tags_future = read_async(db_, [this](Database& db) { return db.get_tags(is_v3_db_); });
+    auto tagged_future = read_async(db_, [](Database& db) { return db.get_tagged_file_ids(); });
+    auto noted_future = read_async(db_, [](Database& db) { return db.get_noted_file_ids(); });
     
     // 加载标签缓存
-    auto tags = db_.get_tags(is_v3_db_);
+    auto tags = tags_future.get();
+    TagTable& table = TagTable::global();
     for (const auto& tag : tags) {
-        tag_cache_[tag.name] = tag.id;
+        TagHandle handle = table.intern(tag.name);
+        if (handle >= tag_ids_.size()) {
+            tag_ids_.resize(handle + 1, 0);
+        }
+        tag_ids_[handle] = tag.id;
+        next_tag_id_ = std::max(next_tag_id_, tag.id + 1);
+        
+        if (is_v3_db_ && tag.parent_id == 0 && tag.name.substr(0, kArtistPrefix.size()) == kArtistPrefix) {
+            legacy_artist_tags_.push_back(tag);
+        }
     }
-    spdlog::info("已加载 {} 个标签", tag_cache_.size());
+    spdlog::info("已加载 {} 个标签", tags.size());
     
     // 加载文件-标签关联
-    auto tag_joins = db_.get_tag_join_files();
-    for (const auto& join : tag_joins) {
-        existing_file_tags_.insert(join.file_id);
-    }
+    auto tagged = tagged_future.get();
+    existing_file_tags_.insert(tagged.begin(), tagged.end());
     spdlog::info("已加载 {} 个文件标签关联", existing_file_tags_.size());
     
     // 加载备注
-    auto notes = db_.get_notes();
-    for (const auto& note : notes) {
-        if (!note.note.empty()) {
-            existing_file_notes_.insert(note.file_id);
+    auto noted = noted_future.get();
+    existing_file_notes_.insert(noted.begin(), noted.end());
+    spdlog::info("已加载 {} 个文件备注", existing_file_notes_.size());
+    
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start_time);
+    spdlog::debug("缓存加载耗时: {} ms", elapsed.count());
+}
+
+bool Processor::reload_tags() {
+    if (!config_.write_tag || staging_) {
+        return true;
+    }
+    
+    auto tags = db_.get_tags(is_v3_db_);
+    
+    // 上一批写入失败留下的新标签先写出，仍然失败时不重建（缓存中还有它们的暂定ID）
+    auto lock = lock_buffers();
+    if (!pending_tags_.empty() && !write_pending_tags()) {
+        return false;
+    }
+    
+    // 整体重建：Billfish 删除或改名的标签不再命中，新建的标签直接复用
+    TagTable& table = TagTable::global();
+    std::fill(tag_ids_.begin(), tag_ids_.end(), 0);
+    for (const auto& tag : tags) {
+        TagHandle handle = table.intern(tag.name);
+        if (handle >= tag_ids_.size()) {
+            tag_ids_.resize(handle + 1, 0);
         }
+        tag_ids_[handle] = tag.id;
+        next_tag_id_ = std::max(next_tag_id_, tag.id + 1);
     }
-    spdlog::info("已加载 {} 个文件备注", existing_file_notes_.size());
+    next_tag_id_ = std::max(next_tag_id_, artist_tag_id_ + 1);
+    spdlog::debug("已重新读取 {} 个标签，下一个标签ID: {}", tags.size(), next_tag_id_);
+    return true;
 }
 
 bool Processor::run() {
@@ -78,6 +202,477 @@ bool Processor::run() {
     }
     
     // 获取文件列表
+    auto files = select_files();
+    spdlog::info("成功加载 {} 个文件", files.size());
+    
+    if (files.empty()) {
+        spdlog::warn("没有文件需要处理");
+        return true;
+    }
+    
+    run_batch(files);
+    
+    if (staging_) {
+        if (!staging_->close()) {
+            return false;
+        }
+        spdlog::info("分片 {}/{}: 已写入 {} 条记录到 {}", config_.shard_index, config_.shard_count,
+                     staging_->record_count(), staging_->path());
+    }
+    
+    return true;
+}
+
+bool Processor::fetch(const std::string& bundle_path) {
+    staging_ = std::make_unique<BundleWriter>(bundle_path);
+    if (!staging_->open()) {
+        return false;
+    }
+    
+    if (!initialize()) {
+        spdlog::error("初始化失败");
+        return false;
+    }
+    
+    // 按PID分组：只要组内有一个文件还需要标签或备注，就抓取该PID
+    auto files = select_files();
+    std::vector<Pid> pids;
+    for (const auto& group : plan_groups(files)) {
+        bool needed = std::any_of(group.rows.begin(), group.rows.end(), [this, &files](FileIndex::Row row) {
+            int64_t file_id = files.id(row);
+            bool need_tag = config_.write_tag &&
+                !(config_.skip_existing && existing_file_tags_.count(file_id) > 0);
+            bool need_note = config_.write_note &&
+                !(config_.skip_existing && existing_file_notes_.count(file_id) > 0);
+            return need_tag || need_note;
+        });
+        
+        if (needed) {
+            pids.push_back(group.pid);
+        }
+    }
+    
+    spdlog::info("抓取模式: {} 个文件, {} 个PID需要请求", files.size(), pids.size());
+    
+    ThreadPool* pool = tag_pool_ ? tag_pool_.get() : note_pool_.get();
+    if (pids.empty() || !pool) {
+        return staging_->close();
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    Statistics stats;
+    std::vector<std::future<void>> futures;
+    futures.reserve(pids.size());
+    int total = static_cast<int>(pids.size());
+    for (size_t i = 0; i < pids.size(); ++i) {
+        futures.push_back(pool->enqueue(
+            &Processor::process_fetch_task, this, pids[i], static_cast<int>(i + 1), total, std::ref(stats)
+        ));
+    }
+    
+    wait_with_progress(futures, [&] {
+        spdlog::info("进度: {}/{} 个PID (失败 {})", stats.done_count(), total, stats.fail_count.load());
+    });
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
+    
+    stats.print("抓取");
+    spdlog::info("总耗时: {} 秒", duration.count());
+    MemoryStats::report();
+    
+    if (!staging_->close()) {
+        return false;
+    }
+    
+    spdlog::info("已写入 {} 条记录到 {}", staging_->record_count(), staging_->path());
+    return true;
+}
+
+void Processor::process_fetch_task(Pid pid, int index, int total, Statistics& stats) {
+    TraceSpan trace("file", "fetch task", "pid", static_cast<int64_t>(pid));
+    
+    // 本PID的临时分配全部来自线程内存池，任务结束时整体释放
+    ArenaScope arena;
+    
+    stats.total_count++;
+    
+    auto illust = pixiv_api_->get_illust(pid);
+    if (!illust) {
+        stats.fail_count++;
+        spdlog::warn("[{}/{}] 获取插画信息失败: PID={}", index, total, pid);
+        return;
+    }
+    
+    std::string_view origin = PixivAPI::format_pid_url(config_.pixiv_artwork_url, pid, origin_buffer);
+    std::pmr::string note = pixiv_api_->format_note(illust->info, pid, origin);
+    
+    staging_->write_illust(pid, illust->tags, note, origin);
+    
+    stats.success_count++;
+    spdlog::debug("[{}/{}] 抓取完成: PID={} ({} tags)", index, total, pid, illust->tags.size());
+}
+
+bool Processor::apply(const std::vector<std::string>& bundle_files) {
+    is_v3_db_ = db_.is_version_3();
+    spdlog::info("数据库版本: {}", is_v3_db_ ? "3.0+" : "2.x");
+    
+    load_cache();
+    
+    if (is_v3_db_ && config_.write_tag) {
+        resolve_artist_tags();
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    // 按PID的记录需要映射到图库中的文件，首次遇到时建立索引
+    std::unordered_map<Pid, std::vector<int64_t>> pid_files;
+    bool pid_index_built = false;
+    auto files_for_pid = [&](Pid pid) -> const std::vector<int64_t>* {
+        if (!pid_index_built) {
+            pid_index_built = true;
+            MemoryStageScope memory_stage(MemoryStage::kDatabase);
+            auto files = db_.get_files_after(0);
+            files.classify();
+            for (FileIndex::Row row = 0; row < files.size(); ++row) {
+                if (files.pid(row) != 0) {
+                    pid_files[files.pid(row)].push_back(files.id(row));
+                }
+            }
+            spdlog::info("已建立PID索引: {} 个PID", pid_files.size());
+        }
+        
+        auto it = pid_files.find(pid);
+        return it == pid_files.end() ? nullptr : &it->second;
+    };
+    
+    // 同一次应用中已写入的文件（防止重复应用同一元数据包时产生重复关联）
+    std::unordered_set<int64_t> applied_tags;
+    std::unordered_set<int64_t> applied_notes;
+    
+    auto apply_to_file = [&](int64_t file_id, const BundleRecord& record) {
+        if (record.has_tags && config_.write_tag) {
+            tag_stats_.total_count++;
+            if (record.tags.empty()) {
+                tag_stats_.fail_count++;
+            } else if ((config_.skip_existing && existing_file_tags_.count(file_id) > 0) ||
+                       !applied_tags.insert(file_id).second) {
+                tag_stats_.skip_count++;
+            } else {
+                add_tags_to_buffer(file_id, record.tags);
+                tag_stats_.success_count++;
+            }
+        }
+        
+        if (record.has_note && config_.write_note) {
+            note_stats_.total_count++;
+            if ((config_.skip_existing && existing_file_notes_.count(file_id) > 0) ||
+                !applied_notes.insert(file_id).second) {
+                note_stats_.skip_count++;
+            } else {
+                add_note_to_buffer(file_id, record.note, record.origin);
+                note_stats_.success_count++;
+            }
+        }
+    };
+    
+    size_t error_count = 0;
+    size_t unmatched_count = 0;
+    
+    for (const auto& path : bundle_files) {
+        BundleReader reader(path);
+        if (!reader.open()) {
+            return false;
+        }
+        
+        size_t record_count = 0;
+        BundleRecord record;
+        while (reader.next(record)) {
+            record_count++;
+            
+            if (record.file_id > 0) {
+                apply_to_file(record.file_id, record);
+            } else if (record.pid == 0) {
+                error_count++;
+            } else if (const auto* file_ids = files_for_pid(record.pid)) {
+                for (int64_t file_id : *file_ids) {
+                    apply_to_file(file_id, record);
+                }
+            } else {
+                unmatched_count++;
+            }
+        }
+        
+        error_count += reader.error_count();
+        spdlog::info("已读取元数据包 {}: {} 条记录", path, record_count);
+    }
+    
+    if (error_count > 0) {
+        spdlog::warn("跳过 {} 条无效记录", error_count);
+    }
+    
+    if (unmatched_count > 0) {
+        spdlog::info("{} 个PID在图库中没有对应文件", unmatched_count);
+    }
+    
+    // 一次性写入
+    spdlog::info("正在写入数据...");
+    
+    bool success = true;
+    if (config_.write_tag) {
+        success = flush_tag_buffer(true) && flush_tag_join_buffer(true) && success;
+    }
+    
+    if (config_.write_note) {
+        success = flush_note_buffer(true) && success;
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
+    
+    if (config_.write_tag) {
+        tag_stats_.print("标签");
+    }
+    
+    if (config_.write_note) {
+        note_stats_.print("备注");
+    }
+    
+    spdlog::info("总耗时: {} 秒", duration.count());
+    MemoryStats::report();
+    
+    return success;
+}
+
+bool Processor::watch(const std::atomic<bool>& stop_flag) {
+    if (!initialize()) {
+        spdlog::error("初始化失败");
+        return false;
+    }
+    
+    // 首轮处理配置范围（或增量同步）内的文件
+    auto files = select_files();
+    spdlog::info("成功加载 {} 个文件", files.size());
+    run_batch(files);
+    
+    // 之后只处理高水位之后新增的文件，缓存与网络连接保持常驻
+    const auto interval = std::chrono::milliseconds(std::max(config_.watch_interval_ms, 100));
+    const auto retry_delay = std::chrono::seconds(60);
+    
+    int64_t data_version = db_.get_data_version();
+    auto last_retry_time = std::chrono::steady_clock::now();
+    max_seen_file_id_ = std::max(max_seen_file_id_, sync_state_.last_file_id);
+    
+    spdlog::info("进入监视模式: 每 {} 毫秒检查一次数据库变化 (文件ID > {})",
+                 interval.count(), sync_state_.last_file_id);
+    
+    while (!stop_flag.load()) {
+        // 分段休眠，便于及时响应退出信号
+        auto wake_time = std::chrono::steady_clock::now() + interval;
+        while (!stop_flag.load() && std::chrono::steady_clock::now() < wake_time) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (stop_flag.load()) {
+            break;
+        }
+        
+        // 其他连接（Billfish）提交写入后 data_version 才会变化
+        int64_t version = db_.get_data_version();
+        bool retry_due = !sync_state_.retry_attempts.empty() &&
+            std::chrono::steady_clock::now() - last_retry_time >= retry_delay;
+        if (version == data_version && !retry_due) {
+            continue;
+        }
+        if (version != data_version && !reload_tags()) {
+            spdlog::debug("新标签仍未写入，下次检查时再重新读取标签表");
+            continue;
+        }
+        data_version = version;
+        
+        // 重试到期时从高水位起重新处理；否则只取处理过的最大文件ID之后新增的文件，
+        // Billfish 的其他写入（修改标签、移动文件等）不会让已处理的文件重复处理
+        int64_t after = retry_due ? sync_state_.last_file_id : max_seen_file_id_;
+        if (retry_due) {
+            last_retry_time = std::chrono::steady_clock::now();
+        }
+        
+        auto delta = db_.get_files_after(after);
+        if (delta.empty()) {
+            continue;
+        }
+        
+        if (retry_due) {
+            spdlog::info("重试: 重新处理 {} 个文件 (文件ID > {})", delta.size(), after);
+        } else {
+            spdlog::info("检测到 {} 个新文件 (文件ID > {})", delta.size(), after);
+        }
+        run_batch(delta);
+    }
+    
+    spdlog::info("监视模式已停止");
+    return true;
+}
+
+void Processor::wait_with_progress(std::vector<std::future<void>>& futures,
+                                   const std::function<void()>& report) {
+    using std::chrono::milliseconds;
+    
+    const milliseconds progress_interval(config_.progress_interval_sec > 0 ? config_.progress_interval_sec * 1000 : 0);
+    const milliseconds flush_interval(std::max(max_write_lag_ms_.load(), 0));
+    
+    if (progress_interval.count() == 0 && flush_interval.count() == 0) {
+        for (auto& future : futures) {
+            future.get();
+        }
+        return;
+    }
+    
+    // 按两者中较短的间隔醒来
+    const milliseconds tick = progress_interval.count() == 0 ? flush_interval :
+                              flush_interval.count() == 0 ? progress_interval :
+                              std::min(progress_interval, flush_interval);
+    auto now = std::chrono::steady_clock::now();
+    auto next_tick = now + tick;
+    auto next_report = now + progress_interval;
+    
+    for (auto& future : futures) {
+        while (future.wait_until(next_tick) == std::future_status::timeout) {
+            next_tick += tick;
+            
+            // 任务稀疏（限速或网络慢）时，已取得的结果也不会长时间积压在缓冲区里
+            if (flush_interval.count() > 0) {
+                flush_overdue();
+            }
+            
+            MemoryStats::sample();
+            
+            if (progress_interval.count() > 0 && std::chrono::steady_clock::now() >= next_report) {
+                report();
+                next_report += progress_interval;
+            }
+        }
+        future.get();
+    }
+}
+
+void Processor::apply_runtime_config(const Config& previous, const Config& updated) {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        
+        if (updated.tag_thread_count != previous.tag_thread_count && updated.tag_thread_count > 0) {
+            tag_thread_count_ = updated.tag_thread_count;
+            if (tag_pool_) {
+                tag_pool_->resize(tag_thread_count_);
+            }
+            spdlog::info("标签线程数: {} -> {}", previous.tag_thread_count, tag_thread_count_);
+        }
+        
+        if (updated.note_thread_count != previous.note_thread_count && updated.note_thread_count > 0) {
+            note_thread_count_ = updated.note_thread_count;
+            if (note_pool_) {
+                note_pool_->resize(note_thread_count_);
+            }
+            spdlog::info("备注线程数: {} -> {}", previous.note_thread_count, note_thread_count_);
+        }
+    }
+    
+    bool timing_changed = updated.target_commit_ms != previous.target_commit_ms ||
+                          updated.max_write_lag_ms != previous.max_write_lag_ms;
+    const std::chrono::milliseconds target_commit(updated.target_commit_ms);
+    const std::chrono::milliseconds max_lag(updated.max_write_lag_ms);
+    
+    {
+        auto lock = lock_buffers();
+        
+        if (timing_changed || updated.batch_size_tag != previous.batch_size_tag) {
+            tag_batch_.reconfigure(updated.batch_size_tag, target_commit, max_lag);
+        }
+        if (timing_changed || updated.batch_size_tag_join != previous.batch_size_tag_join) {
+            tag_join_batch_.reconfigure(updated.batch_size_tag_join, target_commit, max_lag);
+        }
+        if (timing_changed || updated.batch_size_note != previous.batch_size_note) {
+            note_batch_.reconfigure(updated.batch_size_note, target_commit, max_lag);
+        }
+    }
+    max_write_lag_ms_ = updated.max_write_lag_ms;
+    
+    if (timing_changed || updated.batch_size_tag != previous.batch_size_tag ||
+        updated.batch_size_tag_join != previous.batch_size_tag_join ||
+        updated.batch_size_note != previous.batch_size_note) {
+        spdlog::info("批量写入参数已更新: 标签 {} / 关联 {} / 备注 {}，目标提交耗时 {} 毫秒，最长等待 {} 毫秒",
+                     updated.batch_size_tag, updated.batch_size_tag_join, updated.batch_size_note,
+                     updated.target_commit_ms, updated.max_write_lag_ms);
+    }
+}
+
+void Processor::flush_overdue() {
+    if (config_.write_tag && !staging_) {
+        flush_tag_buffer(false);
+        flush_tag_join_buffer(false);
+    }
+    
+    if (config_.write_note && !staging_) {
+        flush_note_buffer(false);
+    }
+}
+
+bool Processor::run_batch(FileIndex& files) {
+    if (files.empty()) {
+        spdlog::warn("没有文件需要处理");
+        return false;
+    }
+    
+    auto start_time = std::chrono::high_resolution_clock::now();
+    
+    // 监视模式下每批单独统计
+    tag_stats_.reset();
+    note_stats_.reset();
+    
+    if (!process_files(files)) {
+        spdlog::error("部分结果未能写入数据库，将从未写入的文件开始重试");
+    }
+    
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
+    
+    // 打印统计信息
+    if (config_.write_tag) {
+        tag_stats_.print("标签");
+    }
+    
+    if (config_.write_note) {
+        note_stats_.print("备注");
+    }
+    
+    spdlog::info("总耗时: {} 秒", duration.count());
+    spdlog::info("插画请求: {} 次, 元数据缓存命中: {} 次",
+                 pixiv_api_->request_count(), pixiv_api_->cache_hits());
+    if (config_.batch_user_fetch && pixiv_api_->batch_request_count() > 0) {
+        spdlog::info("作者批量接口请求: {} 次, 预取作品: {} 个",
+                     pixiv_api_->batch_request_count(), pixiv_api_->batch_prefetch_count());
+    }
+    MemoryStats::report();
+    
+    // 推进高水位
+    return advance_sync_state(files);
+}
+
+FileIndex Processor::select_files() {
+    MemoryStageScope memory_stage(MemoryStage::kDatabase);
+    
+    if (config_.incremental) {
+        sync_state_ = SyncState();
+        if (sync_state_.load_from_file(config_.sync_state_path())) {
+            spdlog::info("增量同步: 上次处理到文件ID {}", sync_state_.last_file_id);
+        } else {
+            spdlog::info("增量同步: 未找到状态文件 {}，将处理全部文件", config_.sync_state_path());
+        }
+        auto files = db_.get_files_after(sync_state_.last_file_id);
+        filter_shard(files);
+        return files;
+    }
+    
     int64_t total_files = db_.get_file_count();
     spdlog::info("数据库中共有 {} 个文件", total_files);
     
@@ -88,32 +683,101 @@ bool Processor::run() {
     spdlog::info("处理范围: {} - {}", start, start + limit);
     
     auto files = db_.get_files(start, limit);
-    spdlog::info("成功加载 {} 个文件", files.size());
+    spdlog::debug("文件索引: {:.1f} 字节/文件", files.bytes_per_row());
+    filter_shard(files);
+    return files;
+}
+
+void Processor::filter_shard(FileIndex& files) const {
+    if (!config_.sharded()) {
+        return;
+    }
     
-    if (files.empty()) {
-        spdlog::warn("没有文件需要处理");
-        return true;
+    const uint64_t shard_count = static_cast<uint64_t>(config_.shard_count);
+    const uint64_t shard_index = static_cast<uint64_t>(config_.shard_index);
+    
+    size_t total = files.size();
+    files.classify();
+    files.retain([&](FileIndex::Row row) {
+        return shard_key(files.id(row), files.pid(row)) % shard_count == shard_index;
+    });
+    
+    spdlog::info("分片 {}/{}: {} / {} 个文件", config_.shard_index, config_.shard_count,
+                 files.size(), total);
+}
+
+std::vector<FileGroup> Processor::plan_groups(FileIndex& files) {
+    std::vector<FileGroup> groups;
+    std::unordered_map<Pid, size_t> group_index;
+    int no_pid_count = 0;
+    
+    if (!files.classified()) {
+        files.classify();
     }
     
-    // 提交任务
-    auto start_time = std::chrono::high_resolution_clock::now();
+    for (FileIndex::Row row = 0; row < files.size(); ++row) {
+        Pid pid = files.pid(row);
+        if (pid == 0) {
+            no_pid_count++;
+            spdlog::debug("无法提取PID: {}", files.name(row));
+            continue;
+        }
+        
+        auto [it, inserted] = group_index.try_emplace(pid, groups.size());
+        if (inserted) {
+            groups.push_back({pid, {}});
+        }
+        groups[it->second].rows.push_back(row);
+    }
+    
+    // 无法提取PID的文件直接计入失败
+    if (config_.write_tag) {
+        tag_stats_.total_count += no_pid_count;
+        tag_stats_.fail_count += no_pid_count;
+    }
+    
+    if (config_.write_note) {
+        note_stats_.total_count += no_pid_count;
+        note_stats_.fail_count += no_pid_count;
+    }
+    
+    size_t grouped = files.size() - no_pid_count;
+    spdlog::info("规划: {} 个文件, {} 个唯一PID (平均每个PID {:.2f} 个文件), {} 个文件无法提取PID",
+                 files.size(), groups.size(),
+                 groups.empty() ? 0.0 : static_cast<double>(grouped) / groups.size(), no_pid_count);
     
+    return groups;
+}
+
+bool Processor::process_files(FileIndex& files) {
+    auto groups = plan_groups(files);
+    
+    // 作者批量预取只服务于标签流水线（批量接口没有备注所需的字段，写备注时仍需逐个请求）
+    if (config_.batch_user_fetch && config_.write_tag && !config_.write_note) {
+        std::vector<Pid> pids;
+        pids.reserve(groups.size());
+        for (const auto& group : groups) {
+            pids.push_back(group.pid);
+        }
+        pixiv_api_->add_batch_candidates(pids);
+    }
+    
+    // 提交任务：每个PID组在每条流水线上一个任务
     std::vector<std::future<void>> futures;
+    int total = static_cast<int>(groups.size());
     
-    for (size_t i = 0; i < files.size(); ++i) {
-        const auto& file = files[i];
+    for (size_t i = 0; i < groups.size(); ++i) {
         int index = static_cast<int>(i + 1);
-        int total = static_cast<int>(files.size());
         
         if (config_.write_tag && tag_pool_) {
             futures.push_back(tag_pool_->enqueue(
-                &Processor::process_tag_task, this, file, index, total
+                &Processor::process_tag_task, this, std::cref(files), std::cref(groups[i]), index, total
             ));
         }
         
         if (config_.write_note && note_pool_) {
             futures.push_back(note_pool_->enqueue(
-                &Processor::process_note_task, this, file, index, total
+                &Processor::process_note_task, this, std::cref(files), std::cref(groups[i]), index, total
             ));
         }
     }
@@ -121,9 +785,14 @@ bool Processor::run() {
     // 等待所有任务完成
     spdlog::info("等待所有任务完成...");
     
-    for (auto& future : futures) {
-        future.get();
-    }
+    wait_with_progress(futures, [&] {
+        spdlog::info("进度: 标签 {}/{}, 备注 {}/{} 个文件, 插画请求 {} 次",
+                     config_.write_tag ? tag_stats_.done_count() : 0,
+                     config_.write_tag ? files.size() : 0,
+                     config_.write_note ? note_stats_.done_count() : 0,
+                     config_.write_note ? files.size() : 0,
+                     pixiv_api_->request_count());
+    });
     
     if (tag_pool_) {
         tag_pool_->wait_all();
@@ -133,182 +802,386 @@ bool Processor::run() {
         note_pool_->wait_all();
     }
     
-    // 刷新剩余缓冲区
+    // 刷新剩余缓冲区（新标签写入失败时不写关联，避免关联指向不存在的标签）
     spdlog::info("正在写入剩余数据...");
     
+    bool flushed = true;
     if (config_.write_tag) {
-        flush_tag_buffer(true);
-        flush_tag_join_buffer(true);
+        flushed = flush_tag_buffer(true) && flush_tag_join_buffer(true);
     }
     
     if (config_.write_note) {
-        flush_note_buffer(true);
+        flushed = flush_note_buffer(true) && flushed;
     }
     
-    auto end_time = std::chrono::high_resolution_clock::now();
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time);
+    // 未写入的记录留在缓冲区中，下次写入时重试；高水位停在这些文件之前
+    if (!flushed) {
+        mark_unflushed_retry();
+    }
+    return flushed;
+}
+
+bool Processor::advance_sync_state(const FileIndex& files) {
+    int64_t last_file_id = sync_state_.last_file_id;
+    for (int64_t file_id : files.ids()) {
+        last_file_id = std::max(last_file_id, file_id);
+    }
+    max_seen_file_id_ = std::max(max_seen_file_id_, last_file_id);
     
-    // 打印统计信息
-    if (config_.write_tag) {
-        tag_stats_.print("标签");
+    std::vector<int64_t> failed;
+    {
+        std::lock_guard<std::mutex> lock(retry_mutex_);
+        failed.swap(failed_files_);
+    }
+    std::sort(failed.begin(), failed.end());
+    failed.erase(std::unique(failed.begin(), failed.end()), failed.end());
+    
+    // 本批重新处理后成功的文件不再重试；失败的文件累计次数，用完重试次数后放弃，高水位不再为它停留
+    auto& attempts = sync_state_.retry_attempts;
+    bool attempts_changed = false;
+    for (int64_t file_id : files.ids()) {
+        if (!std::binary_search(failed.begin(), failed.end(), file_id) && attempts.erase(file_id) > 0) {
+            attempts_changed = true;
+        }
+    }
+    std::vector<int64_t> given_up;
+    for (int64_t file_id : failed) {
+        attempts_changed = true;
+        if (++attempts[file_id] >= kMaxRetryAttempts) {
+            attempts.erase(file_id);
+            given_up.push_back(file_id);
+        }
+    }
+    if (!given_up.empty()) {
+        spdlog::warn("同步: {} 个文件已连续失败 {} 次，不再重试 (文件ID {} 等)",
+                     given_up.size(), kMaxRetryAttempts, given_up.front());
     }
     
-    if (config_.write_note) {
-        note_stats_.print("备注");
+    // 高水位停在第一个需要重试的文件之前，下次从它开始
+    bool retry_pending = !attempts.empty();
+    if (retry_pending) {
+        int64_t retry_file_id = attempts.begin()->first;
+        last_file_id = std::min(last_file_id, retry_file_id - 1);
+        spdlog::info("同步: 文件ID {} 起有文件未完成，下次从该文件重试 (共 {} 个待重试)",
+                     retry_file_id, attempts.size());
     }
     
-    spdlog::info("总耗时: {} 秒", duration.count());
+    bool advanced = last_file_id > sync_state_.last_file_id;
+    if (advanced) {
+        sync_state_.last_file_id = last_file_id;
+    }
     
-    // 更新Artist标签（仅V3数据库）
-    if (is_v3_db_ && config_.write_tag) {
-        update_artist_tags();
+    if (config_.incremental && (advanced || attempts_changed)) {
+        if (!sync_state_.save_to_file(config_.sync_state_path())) {
+            spdlog::error("保存同步状态失败: {}", config_.sync_state_path());
+        } else if (advanced) {
+            spdlog::info("增量同步: 高水位已更新为文件ID {}", last_file_id);
+        }
     }
     
-    return true;
+    return retry_pending;
+}
+
+void Processor::mark_retry(int64_t file_id) {
+    std::lock_guard<std::mutex> lock(retry_mutex_);
+    failed_files_.push_back(file_id);
 }
 
-void Processor::process_tag_task(const FileRecord& file, int index, int total) {
-    tag_stats_.total_count++;
+void Processor::mark_unflushed_retry() {
+    auto lock = lock_buffers();
     
-    // 提取PID
-    auto pid_opt = PixivAPI::extract_pid(file.name);
-    if (!pid_opt) {
-        tag_stats_.fail_count++;
-        spdlog::debug("[{}/{}] 无法提取PID: {}", index, total, file.name);
-        return;
+    for (const auto& join : pending_tag_joins_) {
+        mark_retry(join.file_id);
+    }
+    for (const auto& note : pending_notes_) {
+        mark_retry(note.file_id);
+    }
+}
+
+void Processor::process_tag_task(const FileIndex& files, const FileGroup& group, int index, int total) {
+    TraceSpan trace("file", "tag task", "pid", static_cast<int64_t>(group.pid));
+    
+    // 本组的临时分配全部来自线程内存池，任务结束时整体释放
+    ArenaScope arena;
+    
+    const Pid pid = group.pid;
+    tag_stats_.total_count += static_cast<int>(group.rows.size());
+    
+    // 组内还需要写入标签的文件
+    std::pmr::vector<FileIndex::Row> pending(current_resource());
+    for (FileIndex::Row row : group.rows) {
+        if (config_.skip_existing && existing_file_tags_.count(files.id(row)) > 0) {
+            tag_stats_.skip_count++;
+            spdlog::debug("[{}/{}] 已有标签，跳过: {}", index, total, files.name(row));
+        } else {
+            pending.push_back(row);
+        }
     }
     
-    std::string pid = *pid_opt;
+    if (pending.empty()) {
+        return;
+    }
     
-    // 检查是否需要跳过
-    if (config_.skip_existing && existing_file_tags_.count(file.id) > 0) {
-        tag_stats_.skip_count++;
-        spdlog::debug("[{}/{}] 已有标签，跳过: {}", index, total, file.name);
+    // 获取标签（整组只请求一次；允许使用作者批量预取的数据）
+    auto illust = pixiv_api_->get_illust(pid, config_.batch_user_fetch);
+    if (!illust || illust->tags.empty()) {
+        tag_stats_.fail_count += static_cast<int>(pending.size());
+        for (FileIndex::Row row : pending) {
+            mark_retry(files.id(row));
+        }
+        spdlog::warn("[{}/{}] 获取标签失败: PID={} ({} 个文件)", index, total, pid, pending.size());
         return;
     }
     
-    // 获取标签
-    auto tags_opt = pixiv_api_->get_tags(pid);
-    if (!tags_opt || tags_opt->empty()) {
-        tag_stats_.fail_count++;
-        spdlog::warn("[{}/{}] 获取标签失败: {}", index, total, file.name);
+    tag_stats_.success_count += static_cast<int>(pending.size());
+    spdlog::debug("[{}/{}] 标签处理完成: {} (PID={}, {} 个文件, {} tags)", 
+                 index, total, files.name(pending.front()), pid, pending.size(), illust->tags.size());
+    
+    if (staging_) {
+        for (FileIndex::Row row : pending) {
+            staging_->write_tags(files.id(row), pid, illust->tags);
+        }
         return;
     }
     
     // 添加到缓冲区
-    add_tags_to_buffer(file.id, *tags_opt);
-    
-    tag_stats_.success_count++;
-    spdlog::info("[{}/{}] 标签处理完成: {} (PID={}, {} tags)", 
-                 index, total, file.name, pid, tags_opt->size());
+    for (FileIndex::Row row : pending) {
+        add_tags_to_buffer(files.id(row), illust->tags);
+    }
     
     // 定期刷新缓冲区
     flush_tag_buffer(false);
     flush_tag_join_buffer(false);
 }
 
-void Processor::process_note_task(const FileRecord& file, int index, int total) {
-    note_stats_.total_count++;
+void Processor::process_note_task(const FileIndex& files, const FileGroup& group, int index, int total) {
+    TraceSpan trace("file", "note task", "pid", static_cast<int64_t>(group.pid));
     
-    // 提取PID
-    auto pid_opt = PixivAPI::extract_pid(file.name);
-    if (!pid_opt) {
-        note_stats_.fail_count++;
-        spdlog::debug("[{}/{}] 无法提取PID: {}", index, total, file.name);
-        return;
-    }
+    // 本组的临时分配全部来自线程内存池，任务结束时整体释放
+    ArenaScope arena;
+    
+    const Pid pid = group.pid;
+    note_stats_.total_count += static_cast<int>(group.rows.size());
     
-    std::string pid = *pid_opt;
+    // 组内还需要写入备注的文件
+    std::pmr::vector<FileIndex::Row> pending(current_resource());
+    for (FileIndex::Row row : group.rows) {
+        if (config_.skip_existing && existing_file_notes_.count(files.id(row)) > 0) {
+            note_stats_.skip_count++;
+            spdlog::debug("[{}/{}] 已有备注，跳过: {}", index, total, files.name(row));
+        } else {
+            pending.push_back(row);
+        }
+    }
     
-    // 检查是否需要跳过
-    if (config_.skip_existing && existing_file_notes_.count(file.id) > 0) {
-        note_stats_.skip_count++;
-        spdlog::debug("[{}/{}] 已有备注，跳过: {}", index, total, file.name);
+    if (pending.empty()) {
         return;
     }
     
-    // 获取插画信息
-    auto info_opt = pixiv_api_->get_illust_info(pid);
-    if (!info_opt) {
-        note_stats_.fail_count++;
-        spdlog::warn("[{}/{}] 获取插画信息失败: {}", index, total, file.name);
+    // 获取插画信息（整组只请求一次）
+    auto illust = pixiv_api_->get_illust(pid);
+    if (!illust) {
+        note_stats_.fail_count += static_cast<int>(pending.size());
+        for (FileIndex::Row row : pending) {
+            mark_retry(files.id(row));
+        }
+        spdlog::warn("[{}/{}] 获取插画信息失败: PID={} ({} 个文件)", index, total, pid, pending.size());
         return;
     }
     
     // 格式化备注
-    std::string note = PixivAPI::format_note(*info_opt);
-    std::string origin = config_.pixiv_artwork_url + pid;
+    std::string_view origin = PixivAPI::format_pid_url(config_.pixiv_artwork_url, pid, origin_buffer);
+    std::pmr::string note = pixiv_api_->format_note(illust->info, pid, origin);
     
-    // 添加到缓冲区
-    add_note_to_buffer(file.id, note, origin);
+    note_stats_.success_count += static_cast<int>(pending.size());
+    spdlog::debug("[{}/{}] 备注处理完成: {} (PID={}, {} 个文件)", 
+                 index, total, files.name(pending.front()), pid, pending.size());
     
-    note_stats_.success_count++;
-    spdlog::info("[{}/{}] 备注处理完成: {} (PID={})", 
-                 index, total, file.name, pid);
+    if (staging_) {
+        for (FileIndex::Row row : pending) {
+            staging_->write_note(files.id(row), pid, note, origin);
+        }
+        return;
+    }
+    
+    // 添加到缓冲区
+    for (FileIndex::Row row : pending) {
+        add_note_to_buffer(files.id(row), note, origin);
+    }
     
     // 定期刷新缓冲区
     flush_note_buffer(false);
 }
 
-void Processor::add_tags_to_buffer(int64_t file_id, const std::vector<std::string>& tags) {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
+std::unique_lock<std::mutex> Processor::lock_buffers() {
+    std::unique_lock<std::mutex> lock(buffer_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        TraceSpan trace("lock", "wait buffer_mutex_");
+        lock.lock();
+    }
+    return lock;
+}
+
+void Processor::add_tags_to_buffer(int64_t file_id, const TagList& tags) {
+    MemoryStageScope memory_stage(MemoryStage::kTags);
+    TraceSpan trace("file", "add tags", "file_id", file_id);
+    auto lock = lock_buffers();
     
-    for (const auto& tag : tags) {
+    if (!tags.empty()) {
+        tag_join_batch_.mark_pending();
+    }
+    
+    for (TagHandle tag : tags) {
         auto tag_id_opt = check_tag_exist(tag);
         
         if (tag_id_opt) {
             // 标签已存在
             pending_tag_joins_.push_back({file_id, *tag_id_opt});
         } else {
-            // 新标签
+            // 新标签；V3数据库的作者标签直接以去掉前缀的名称创建在Artist父标签下
             int64_t new_tag_id = generate_tag_id();
-            pending_tags_.push_back({new_tag_id, tag});
+            tag_batch_.mark_pending();
+            std::string_view tag_name = TagTable::global().name(tag);
+            if (artist_tag_id_ != 0 && tag_name.substr(0, kArtistPrefix.size()) == kArtistPrefix) {
+                pending_tags_.push_back({new_tag_id, tag_name.substr(kArtistPrefix.size()), artist_tag_id_});
+            } else {
+                pending_tags_.push_back({new_tag_id, tag_name});
+            }
             pending_tag_joins_.push_back({file_id, new_tag_id});
             
             // 更新缓存
-            tag_cache_[tag] = new_tag_id;
+            if (tag >= tag_ids_.size()) {
+                tag_ids_.resize(tag + 1, 0);
+            }
+            tag_ids_[tag] = new_tag_id;
         }
     }
 }
 
-void Processor::add_note_to_buffer(int64_t file_id, const std::string& note, const std::string& origin) {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
-    
+void Processor::add_note_to_buffer(int64_t file_id, std::string_view note, std::string_view origin) {
+    TraceSpan trace("file", "add note", "file_id", file_id);
     NoteRecord record;
     record.file_id = file_id;
-    record.note = note + "\r\nOrigin:" + origin;
+    record.note = note;
+    record.origin = origin;
     
-    pending_notes_.push_back(record);
+    auto lock = lock_buffers();
+    pending_notes_.push_back(std::move(record));
+    note_batch_.mark_pending();
 }
 
 bool Processor::flush_tag_buffer(bool force) {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    MemoryStageScope memory_stage(MemoryStage::kDatabase);
+    auto lock = lock_buffers();
     
-    if (pending_tags_.empty() || 
-        (!force && pending_tags_.size() < static_cast<size_t>(config_.batch_size_tag))) {
+    if (pending_tags_.empty() || (!force && !tag_batch_.should_flush(pending_tags_.size()))) {
         return true;
     }
     
-    bool success = db_.insert_tags(pending_tags_, is_v3_db_);
-    if (success) {
-        spdlog::debug("已写入 {} 个标签", pending_tags_.size());
+    return write_pending_tags();
+}
+
+bool Processor::write_pending_tags() {
+    auto start = AdaptiveBatch::Clock::now();
+    TagInsertResult result = db_.insert_tags(pending_tags_, is_v3_db_);
+    auto end = AdaptiveBatch::Clock::now();
+    tag_batch_.record_commit(pending_tags_.size(), end - start, result.ok);
+    Trace::record("db", "commit tags", start, end, "rows", static_cast<int64_t>(pending_tags_.size()));
+    
+    if (result.ok) {
+        spdlog::debug("已写入 {} 个标签（{} 个改用已有或重新分配的ID）", pending_tags_.size(), result.remapped.size());
+        remap_tag_ids(result.remapped);
         pending_tags_.clear();
+        return true;
     }
     
-    return success;
+    // 无法重试的失败：丢弃本批新标签，引用它们的关联不再写入，相关文件记为需要重试
+    if (!result.retryable) {
+        std::vector<std::pair<int64_t, int64_t>> dropped;
+        dropped.reserve(pending_tags_.size());
+        for (const auto& tag : pending_tags_) {
+            dropped.emplace_back(tag.id, 0);
+        }
+        spdlog::error("丢弃 {} 个无法写入的新标签，相关文件下次重试", pending_tags_.size());
+        remap_tag_ids(dropped);
+        pending_tags_.clear();
+    }
+    
+    return false;
+}
+
+void Processor::remap_tag_ids(const std::vector<std::pair<int64_t, int64_t>>& remapped) {
+    if (remapped.empty()) {
+        return;
+    }
+    
+    std::unordered_map<int64_t, int64_t> ids(remapped.begin(), remapped.end());
+    for (int64_t& id : tag_ids_) {
+        if (auto it = ids.find(id); it != ids.end()) {
+            id = it->second;
+        }
+    }
+    
+    // 关联改指实际ID；目标为 0 的关联丢弃，文件记为需要重试
+    size_t kept = 0;
+    for (const auto& join : pending_tag_joins_) {
+        int64_t tag_id = join.tag_id;
+        if (auto it = ids.find(tag_id); it != ids.end()) {
+            tag_id = it->second;
+        }
+        if (tag_id == 0) {
+            mark_retry(join.file_id);
+            continue;
+        }
+        pending_tag_joins_[kept++] = {join.file_id, tag_id};
+    }
+    pending_tag_joins_.resize(kept);
+    
+    for (const auto& [pending_id, actual_id] : remapped) {
+        next_tag_id_ = std::max(next_tag_id_, actual_id + 1);
+    }
 }
 
 bool Processor::flush_tag_join_buffer(bool force) {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    MemoryStageScope memory_stage(MemoryStage::kDatabase);
+    auto lock = lock_buffers();
     
-    if (pending_tag_joins_.empty() || 
-        (!force && pending_tag_joins_.size() < static_cast<size_t>(config_.batch_size_tag_join))) {
+    if (pending_tag_joins_.empty() || (!force && !tag_join_batch_.should_flush(pending_tag_joins_.size()))) {
         return true;
     }
     
-    bool success = db_.insert_tag_join_files(pending_tag_joins_);
+    // 关联引用的新标签必须先写入：在同一把锁内写出缓冲区中的标签，失败时不写关联，
+    // 否则关联会指向数据库中不存在（之后可能被 Billfish 分配给其他标签）的ID
+    if (!pending_tags_.empty() && !write_pending_tags()) {
+        return false;
+    }
+    
+    // 批内去重：同一标签重复出现、或 "Artist:xxx" 与 "xxx" 解析到同一标签ID时会产生重复关联。
+    // 排序后按 (file_id, tag_id) 顺序写入，也让索引插入更集中
+    size_t buffered = pending_tag_joins_.size();
+    std::sort(pending_tag_joins_.begin(), pending_tag_joins_.end(),
+              [](const TagJoinFileRecord& a, const TagJoinFileRecord& b) {
+                  return a.file_id != b.file_id ? a.file_id < b.file_id : a.tag_id < b.tag_id;
+              });
+    pending_tag_joins_.erase(
+        std::unique(pending_tag_joins_.begin(), pending_tag_joins_.end(),
+                    [](const TagJoinFileRecord& a, const TagJoinFileRecord& b) {
+                        return a.file_id == b.file_id && a.tag_id == b.tag_id;
+                    }),
+        pending_tag_joins_.end());
+    
+    auto start = AdaptiveBatch::Clock::now();
+    bool success = db_.insert_tag_join_files(pending_tag_joins_, config_.skip_existing);
+    size_t limit = tag_join_batch_.limit();
+    auto end = AdaptiveBatch::Clock::now();
+    tag_join_batch_.record_commit(pending_tag_joins_.size(), end - start, success);
+    Trace::record("db", "commit tag joins", start, end, "rows", static_cast<int64_t>(pending_tag_joins_.size()));
+    if (limit != tag_join_batch_.limit()) {
+        spdlog::debug("文件-标签关联批量大小: {} -> {}", limit, tag_join_batch_.limit());
+    }
     if (success) {
-        spdlog::debug("已写入 {} 个文件-标签关联", pending_tag_joins_.size());
+        spdlog::debug("已写入 {} 个文件-标签关联 (批内去重 {} 个)",
+                      pending_tag_joins_.size(), buffered - pending_tag_joins_.size());
         
         // 更新缓存
         for (const auto& join : pending_tag_joins_) {
@@ -322,14 +1195,22 @@ bool Processor::flush_tag_join_buffer(bool force) {
 }
 
 bool Processor::flush_note_buffer(bool force) {
-    std::lock_guard<std::mutex> lock(buffer_mutex_);
+    MemoryStageScope memory_stage(MemoryStage::kDatabase);
+    auto lock = lock_buffers();
     
-    if (pending_notes_.empty() || 
-        (!force && pending_notes_.size() < static_cast<size_t>(config_.batch_size_note))) {
+    if (pending_notes_.empty() || (!force && !note_batch_.should_flush(pending_notes_.size()))) {
         return true;
     }
     
-    bool success = db_.insert_notes(pending_notes_);
+    auto start = AdaptiveBatch::Clock::now();
+    bool success = db_.insert_notes(pending_notes_, config_.skip_existing);
+    size_t limit = note_batch_.limit();
+    auto end = AdaptiveBatch::Clock::now();
+    note_batch_.record_commit(pending_notes_.size(), end - start, success);
+    Trace::record("db", "commit notes", start, end, "rows", static_cast<int64_t>(pending_notes_.size()));
+    if (limit != note_batch_.limit()) {
+        spdlog::debug("备注批量大小: {} -> {}", limit, note_batch_.limit());
+    }
     if (success) {
         spdlog::debug("已写入 {} 个备注", pending_notes_.size());
         
@@ -344,75 +1225,64 @@ bool Processor::flush_note_buffer(bool force) {
     return success;
 }
 
-std::optional<int64_t> Processor::check_tag_exist(const std::string& tag_name) {
-    // 对于Artist标签，尝试两种形式
-    if (is_v3_db_ && tag_name.find("Artist:") == 0) {
-        std::string simple_name = tag_name.substr(7);
-        auto it = tag_cache_.find(simple_name);
-        if (it != tag_cache_.end()) {
-            return it->second;
+std::optional<int64_t> Processor::check_tag_exist(TagHandle tag) {
+    auto lookup = [this](TagHandle handle) -> std::optional<int64_t> {
+        if (handle < tag_ids_.size() && tag_ids_[handle] != 0) {
+            return tag_ids_[handle];
         }
-    }
+        return std::nullopt;
+    };
     
-    auto it = tag_cache_.find(tag_name);
-    if (it != tag_cache_.end()) {
-        return it->second;
+    // 对于Artist标签，尝试两种形式
+    if (is_v3_db_) {
+        std::string_view tag_name = TagTable::global().name(tag);
+        if (tag_name.substr(0, kArtistPrefix.size()) == kArtistPrefix) {
+            auto simple = TagTable::global().find(tag_name.substr(kArtistPrefix.size()));
+            if (simple) {
+                if (auto id = lookup(*simple)) {
+                    return id;
+                }
+            }
+        }
     }
     
-    return std::nullopt;
+    return lookup(tag);
 }
 
 int64_t Processor::generate_tag_id() {
-    if (tag_cache_.empty()) {
-        return 1;
-    }
-    
-    // 找到最大ID
-    int64_t max_id = 0;
-    for (const auto& [name, id] : tag_cache_) {
-        if (id > max_id) {
-            max_id = id;
-        }
-    }
-    
-    return max_id + 1;
+    return next_tag_id_++;
 }
 
-void Processor::update_artist_tags() {
-    spdlog::info("更新Artist标签...");
-    
+void Processor::resolve_artist_tags() {
     // 获取或创建Artist父标签
     auto artist_id_opt = db_.get_artist_tag_id();
     if (!artist_id_opt) {
         if (!db_.create_artist_tag()) {
-            spdlog::error("创建Artist父标签失败");
+            spdlog::error("创建Artist父标签失败，作者标签将按原名写入");
             return;
         }
         artist_id_opt = db_.get_artist_tag_id();
         if (!artist_id_opt) {
-            spdlog::error("获取Artist标签ID失败");
+            spdlog::error("获取Artist标签ID失败，作者标签将按原名写入");
             return;
         }
     }
     
-    int64_t artist_id = *artist_id_opt;
-    spdlog::info("Artist父标签ID: {}", artist_id);
+    artist_tag_id_ = *artist_id_opt;
+    next_tag_id_ = std::max(next_tag_id_, artist_tag_id_ + 1);  // 新建的父标签可能占用了下一个ID
+    spdlog::info("Artist父标签ID: {}", artist_tag_id_);
     
-    // 获取需要更新的Artist子标签
-    auto artist_subtags = db_.get_artist_subtags();
-    if (artist_subtags.empty()) {
-        spdlog::info("没有需要更新的Artist标签");
+    // 迁移旧版本写入的 "Artist:xxx" 标签（加载缓存时已经顺带找出，不再单独扫描标签表）
+    if (legacy_artist_tags_.empty()) {
         return;
     }
     
-    spdlog::info("找到 {} 个Artist子标签需要更新", artist_subtags.size());
-    
-    // 更新标签
-    if (db_.update_artist_tags(artist_subtags, artist_id)) {
-        spdlog::info("Artist标签更新成功");
-    } else {
-        spdlog::error("Artist标签更新失败");
+    spdlog::info("迁移 {} 个旧版Artist标签", legacy_artist_tags_.size());
+    if (!db_.update_artist_tags(legacy_artist_tags_, artist_tag_id_)) {
+        spdlog::error("Artist标签迁移失败");
     }
+    legacy_artist_tags_.clear();
+    legacy_artist_tags_.shrink_to_fit();
 }
 
 } // namespace pixiv2billfish
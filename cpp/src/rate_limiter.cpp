@@ -0,0 +1,40 @@
+#include "rate_limiter.h"
+#include <algorithm>
+#include <thread>
+
+namespace pixiv2billfish {
+
+RateLimiter::RateLimiter(double requests_per_second) : next_slot_(Clock::now()) {
+    set_rate(requests_per_second);
+}
+
+void RateLimiter::set_rate(double requests_per_second) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (requests_per_second <= 0) {
+        interval_ = Clock::duration::zero();
+    } else {
+        interval_ = std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(1.0 / requests_per_second));
+    }
+}
+
+void RateLimiter::acquire() {
+    Clock::time_point slot;
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        
+        if (interval_ == Clock::duration::zero()) {
+            return;
+        }
+        
+        // 空闲后不积攒额度，最多立即放行一个请求
+        slot = std::max(next_slot_, Clock::now());
+        next_slot_ = slot + interval_;
+    }
+    
+    std::this_thread::sleep_until(slot);
+}
+
+} // namespace pixiv2billfish
@@ -0,0 +1,63 @@
+#include "tag_table.h"
+#include <cstring>
+#include <mutex>
+
+namespace pixiv2billfish {
+
+TagTable& TagTable::global() {
+    static TagTable table;
+    return table;
+}
+
+TagTable::TagTable() : storage_(64 * 1024) {
+}
+
+TagHandle TagTable::intern(std::string_view name) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = index_.find(name);
+        if (it != index_.end()) {
+            return it->second;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    
+    // 加锁期间可能已被其他线程插入
+    auto it = index_.find(name);
+    if (it != index_.end()) {
+        return it->second;
+    }
+    
+    char* data = static_cast<char*>(storage_.allocate(name.size() + 1, 1));
+    std::memcpy(data, name.data(), name.size());
+    data[name.size()] = '\0';
+    
+    std::string_view stored(data, name.size());
+    auto handle = static_cast<TagHandle>(names_.size());
+    names_.push_back(stored);
+    index_.emplace(stored, handle);
+    
+    return handle;
+}
+
+std::optional<TagHandle> TagTable::find(std::string_view name) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = index_.find(name);
+    if (it == index_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::string_view TagTable::name(TagHandle handle) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_[handle];
+}
+
+size_t TagTable::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return names_.size();
+}
+
+} // namespace pixiv2billfish
@@ -1,4 +1,5 @@
 #include "thread_pool.h"
+#include <algorithm>
 
 namespace pixiv2billfish {
 
@@ -6,6 +7,7 @@ ThreadPool::ThreadPool(size_t num_threads)
     : stop_(false), active_tasks_(0) {
     
     workers_.reserve(num_threads);
+    target_threads_ = num_threads;
     
     for (size_t i = 0; i < num_threads; ++i) {
         workers_.emplace_back(&ThreadPool::worker_thread, this);
@@ -24,13 +26,20 @@ void ThreadPool::worker_thread() {
             std::unique_lock<std::mutex> lock(queue_mutex_);
             
             condition_.wait(lock, [this] {
-                return stop_ || !tasks_.empty();
+                return stop_ || !tasks_.empty() || retire_count_ > 0;
             });
             
             if (stop_ && tasks_.empty()) {
                 return;
             }
             
+            // 线程数已调小：在两个任务之间退出
+            if (retire_count_ > 0 && !stop_) {
+                --retire_count_;
+                retired_.push_back(std::this_thread::get_id());
+                return;
+            }
+            
             task = std::move(tasks_.front());
             tasks_.pop();
             
@@ -67,6 +76,53 @@ size_t ThreadPool::pending_tasks() const {
     return tasks_.size();
 }
 
+void ThreadPool::resize(size_t num_threads) {
+    std::vector<std::thread> finished;
+    
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        
+        if (stop_ || num_threads == target_threads_) {
+            return;
+        }
+        
+        // 取出已退出的线程，在锁外 join
+        for (std::thread::id id : retired_) {
+            auto it = std::find_if(workers_.begin(), workers_.end(),
+                                   [id](const std::thread& worker) { return worker.get_id() == id; });
+            if (it != workers_.end()) {
+                finished.push_back(std::move(*it));
+                workers_.erase(it);
+            }
+        }
+        retired_.clear();
+        
+        if (num_threads < target_threads_) {
+            retire_count_ += target_threads_ - num_threads;
+        } else {
+            // 先撤销尚未执行的退出，不足的部分再启动新线程
+            size_t grow = num_threads - target_threads_;
+            size_t cancelled = std::min(grow, retire_count_);
+            retire_count_ -= cancelled;
+            for (size_t i = cancelled; i < grow; ++i) {
+                workers_.emplace_back(&ThreadPool::worker_thread, this);
+            }
+        }
+        target_threads_ = num_threads;
+    }
+    
+    condition_.notify_all();
+    
+    for (auto& worker : finished) {
+        worker.join();
+    }
+}
+
+size_t ThreadPool::size() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return target_threads_;
+}
+
 void ThreadPool::shutdown() {
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
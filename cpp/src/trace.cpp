@@ -0,0 +1,140 @@
+#include "trace.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace pixiv2billfish {
+
+namespace {
+
+struct Event {
+    const char* category;
+    const char* name;
+    const char* arg_name;
+    int64_t arg;
+    int64_t start_ns;
+    int64_t duration_ns;
+};
+
+// 单个线程的环形缓冲区，只由所属线程写入
+struct ThreadBuffer {
+    uint32_t tid = 0;
+    std::vector<Event> events;
+    std::atomic<uint64_t> written{0};  // 累计写入的事件数，位置为 written % 容量
+};
+
+std::mutex g_mutex;  // 保护以下状态（记录事件时不使用）
+std::vector<std::unique_ptr<ThreadBuffer>> g_buffers;
+std::string g_path;
+size_t g_capacity = 0;
+Trace::Clock::time_point g_origin;
+bool g_started = false;
+
+ThreadBuffer* local_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        auto created = std::make_unique<ThreadBuffer>();
+        created->tid = static_cast<uint32_t>(g_buffers.size() + 1);
+        created->events.resize(g_capacity);
+        buffer = created.get();
+        g_buffers.push_back(std::move(created));
+    }
+    return buffer;
+}
+
+int64_t since_origin(Trace::Clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time - g_origin).count();
+}
+
+} // namespace
+
+void Trace::start(const std::string& path, size_t events_per_thread) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    
+    if (g_started) {
+        spdlog::warn("追踪已经启动，忽略: {}", path);
+        return;
+    }
+    
+    g_started = true;
+    g_path = path;
+    g_capacity = std::max<size_t>(events_per_thread, 1);
+    g_origin = Clock::now();
+    enabled_.store(true, std::memory_order_release);
+    
+    spdlog::info("追踪已启用: {} (每线程 {} 个事件)", path, g_capacity);
+}
+
+void Trace::record(const char* category, const char* name, Clock::time_point start, Clock::time_point end,
+                   const char* arg_name, int64_t arg) {
+    if (!enabled()) {
+        return;
+    }
+    
+    ThreadBuffer* buffer = local_buffer();
+    uint64_t index = buffer->written.load(std::memory_order_relaxed);
+    Event& event = buffer->events[index % buffer->events.size()];
+    event.category = category;
+    event.name = name;
+    event.arg_name = arg_name;
+    event.arg = arg;
+    event.start_ns = since_origin(start);
+    event.duration_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    buffer->written.store(index + 1, std::memory_order_release);
+}
+
+bool Trace::stop() {
+    if (!enabled_.exchange(false)) {
+        return true;
+    }
+    
+    std::lock_guard<std::mutex> lock(g_mutex);
+    
+    FILE* file = std::fopen(g_path.c_str(), "wb");
+    if (!file) {
+        spdlog::error("无法写入追踪文件: {}", g_path);
+        return false;
+    }
+    
+    std::fputs("{\"traceEvents\":[\n", file);
+    std::fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Pixiv2Billfish\"}}", file);
+    
+    size_t exported = 0;
+    uint64_t overwritten = 0;
+    for (const auto& buffer : g_buffers) {
+        uint64_t written = buffer->written.load(std::memory_order_acquire);
+        uint64_t capacity = buffer->events.size();
+        uint64_t count = std::min(written, capacity);
+        overwritten += written - count;
+        
+        // 从最旧的事件开始输出
+        for (uint64_t i = written - count; i < written; ++i) {
+            const Event& event = buffer->events[i % capacity];
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%" PRIu32,
+                         event.name, event.category, event.start_ns / 1000.0, event.duration_ns / 1000.0, buffer->tid);
+            if (event.arg_name) {
+                std::fprintf(file, ",\"args\":{\"%s\":%" PRId64 "}", event.arg_name, event.arg);
+            }
+            std::fputc('}', file);
+        }
+        exported += count;
+    }
+    
+    std::fputs("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+    bool ok = std::fclose(file) == 0;
+    
+    if (overwritten > 0) {
+        spdlog::info("追踪已写入 {}: {} 个事件，{} 个线程（环形缓冲区覆盖了最早的 {} 个事件）",
+                     g_path, exported, g_buffers.size(), overwritten);
+    } else {
+        spdlog::info("追踪已写入 {}: {} 个事件，{} 个线程", g_path, exported, g_buffers.size());
+    }
+    return ok;
+}
+
+} // namespace pixiv2billfish
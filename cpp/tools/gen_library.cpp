@@ -0,0 +1,79 @@
+// 合成图库生成器：生成指定规模的 Billfish 2.x / 3.0 结构数据库（可同时生成抓取包），用于规模测试
+#include "library_generator.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+
+namespace {
+
+void print_usage(const char* program) {
+    std::fprintf(stderr,
+                 "用法: %s <输出数据库> [--files N] [--v3] [--tags N] [--tags-per-file N]\n"
+                 "          [--tagged 比例] [--noted 比例] [--non-pixiv 比例] [--seed N] [--bundle <抓取包>]\n",
+                 program);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    using namespace pixiv2billfish::tools;
+    
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return 2;
+    }
+    
+    std::string path = argv[1];
+    LibraryOptions options;
+    
+    for (int i = 2; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--v3") {
+            options.v3 = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        const char* value = argv[++i];
+        if (arg == "--files") {
+            options.file_count = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--tags") {
+            options.tag_count = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--tags-per-file") {
+            options.tags_per_file = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--tagged") {
+            options.tagged_ratio = std::strtod(value, nullptr);
+        } else if (arg == "--noted") {
+            options.noted_ratio = std::strtod(value, nullptr);
+        } else if (arg == "--non-pixiv") {
+            options.non_pixiv_ratio = std::strtod(value, nullptr);
+        } else if (arg == "--seed") {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (arg == "--bundle") {
+            options.bundle_path = value;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+    
+    auto start = std::chrono::steady_clock::now();
+    LibraryStats stats;
+    if (!generate_library(path, options, stats)) {
+        std::fprintf(stderr, "生成失败: %s\n", path.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    
+    std::printf("%s (%s): %zu 个文件, %zu 个PID, %zu 个标签, %zu 条关联, %zu 条备注, 耗时 %.2f 秒\n",
+                path.c_str(), options.v3 ? "3.0" : "2.x", stats.files, stats.pids, stats.tags,
+                stats.tag_joins, stats.notes, seconds);
+    if (!options.bundle_path.empty()) {
+        std::printf("抓取包 %s: %zu 条记录\n", options.bundle_path.c_str(), stats.bundle_records);
+    }
+    return 0;
+}
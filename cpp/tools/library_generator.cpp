@@ -0,0 +1,332 @@
+#include "library_generator.h"
+#include "bundle.h"
+#include "tag_table.h"
+#include <sqlite3.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pixiv2billfish::tools {
+
+namespace {
+
+// 两种版本共有的表（取自 Billfish 2.x 图库）
+constexpr const char* kCommonSchema = R"(
+CREATE TABLE library (id INTEGER PRIMARY KEY AUTOINCREMENT, version INTEGER, platform TEXT);
+CREATE TABLE bf_folder (id INTEGER PRIMARY KEY AUTOINCREMENT, born INTEGER, pid INTEGER NOT NULL, name TEXT, desc TEXT, cover_tid INTEGER, hide INTEGER, seq REAL, color INTEGER, is_recycle INTEGER);
+CREATE INDEX bf_folder_pid_idx on bf_folder(pid);
+CREATE TABLE bf_material_userdata (id INTEGER PRIMARY KEY AUTOINCREMENT, file_id INTEGER NOT NULL, comments_summary TEXT, comments_count INTEGER, comments_detail TEXT, note TEXT, origin TEXT, score INTEGER, rotation INTEGER, hflip INTEGER, vflip INTEGER, cover_tid TEXT, unique(file_id) on conflict replace);
+CREATE TABLE bf_tag(id integer primary key autoincrement, name TEXT, color INTEGER, born INTEGER);
+CREATE TABLE bf_tag_join_file(id integer primary key autoincrement, file_id integer, tag_id integer, born integer,unique(file_id, tag_id) on conflict ignore);
+CREATE TABLE "bf_file" ("id" INTEGER PRIMARY KEY AUTOINCREMENT, "name" TEXT, "pid" INTEGER NOT NULL, "is_hide" INTEGER, "is_link" INTEGER, "file_size" INTEGER, "ctime" INTEGER, "mtime" INTEGER, "md5" TEXT, "tid" INTEGER, "born" INTEGER, "ttid" INTEGER);
+CREATE INDEX "bf_file_pid_idx" ON "bf_file" ("pid" ASC);
+)";
+
+// 2.x：关联按文件ID建索引
+constexpr const char* kV2Schema = R"(
+CREATE INDEX bf_tag_join_file_idx on bf_tag_join_file(file_id);
+)";
+
+// 3.0：层级标签表，关联按标签ID建索引
+constexpr const char* kV3Schema = R"(
+CREATE TABLE bf_tag_v2(id integer primary key autoincrement,name text,pid integer,seq real,icon integer,color integer,born integer);
+CREATE INDEX bf_tag_join_file_idx on bf_tag_join_file(tag_id);
+)";
+
+constexpr int64_t kBornTime = 1651940896;
+constexpr int64_t kFolderCount = 100;
+
+class Statement {
+public:
+    Statement(sqlite3* db, const char* sql) {
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt_, nullptr) != SQLITE_OK) {
+            spdlog::error("准备语句失败: {} ({})", sql, sqlite3_errmsg(db));
+            stmt_ = nullptr;
+        }
+    }
+    
+    ~Statement() {
+        sqlite3_finalize(stmt_);
+    }
+    
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+    
+    explicit operator bool() const { return stmt_ != nullptr; }
+    
+    Statement& bind(int index, int64_t value) {
+        sqlite3_bind_int64(stmt_, index, value);
+        return *this;
+    }
+    
+    Statement& bind(int index, std::string_view value) {
+        sqlite3_bind_text(stmt_, index, value.data(), static_cast<int>(value.size()), SQLITE_TRANSIENT);
+        return *this;
+    }
+    
+    // 执行并重置，供下一行复用
+    bool run() {
+        int rc = sqlite3_step(stmt_);
+        sqlite3_reset(stmt_);
+        return rc == SQLITE_DONE;
+    }
+
+private:
+    sqlite3_stmt* stmt_ = nullptr;
+};
+
+bool execute(sqlite3* db, const char* sql) {
+    char* error = nullptr;
+    if (sqlite3_exec(db, sql, nullptr, nullptr, &error) != SQLITE_OK) {
+        spdlog::error("SQL执行失败: {}", error ? error : "");
+        sqlite3_free(error);
+        return false;
+    }
+    return true;
+}
+
+// 标签名：日文、英文与翻译后的标签混合
+std::string make_tag_name(size_t index) {
+    static constexpr std::string_view kStems[] = {
+        "オリジナル", "女の子", "風景", "original", "landscape", "ファンタジー", "制服", "猫"
+    };
+    std::string name(kStems[index % (sizeof(kStems) / sizeof(kStems[0]))]);
+    name += std::to_string(index);
+    return name;
+}
+
+std::string make_md5(std::mt19937_64& rng) {
+    static constexpr char kHex[] = "0123456789ABCDEF";
+    std::string md5(32, '0');
+    uint64_t high = rng();
+    uint64_t low = rng();
+    for (int i = 0; i < 16; ++i) {
+        md5[i] = kHex[(high >> (i * 4)) & 0xF];
+        md5[16 + i] = kHex[(low >> (i * 4)) & 0xF];
+    }
+    return md5;
+}
+
+std::string make_note(Pid pid, std::string_view artist, int64_t uid, std::mt19937_64& rng) {
+    std::string note = "Title:作品 " + std::to_string(pid) + "\r\nArtist:" + std::string(artist) +
+                       "\r\nUID:" + std::to_string(uid) + "\r\nBookmark:" + std::to_string(rng() % 20000) + "\r\n";
+    note += rng() % 2 ? "Comment:\r\nコメントです。\r\n詳細はプロフィールへ" : "No Comment\r\n";
+    return note;
+}
+
+} // namespace
+
+bool generate_library(const std::string& path, const LibraryOptions& options, LibraryStats& stats) {
+    std::error_code ec;
+    for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+        std::filesystem::remove(path + suffix, ec);
+    }
+    
+    sqlite3* db = nullptr;
+    if (sqlite3_open(path.c_str(), &db) != SQLITE_OK) {
+        spdlog::error("无法创建数据库: {}", path);
+        sqlite3_close(db);
+        return false;
+    }
+    std::unique_ptr<sqlite3, decltype(&sqlite3_close)> db_guard(db, &sqlite3_close);
+    
+    // 一次性生成，不需要日志与同步
+    if (!execute(db, "PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF;") ||
+        !execute(db, kCommonSchema) || !execute(db, options.v3 ? kV3Schema : kV2Schema) ||
+        !execute(db, "BEGIN")) {
+        return false;
+    }
+    
+    std::unique_ptr<BundleWriter> bundle;
+    if (!options.bundle_path.empty()) {
+        bundle = std::make_unique<BundleWriter>(options.bundle_path);
+        if (!bundle->open()) {
+            return false;
+        }
+    }
+    
+    {
+        Statement insert_library(db, "INSERT INTO library (version, platform) VALUES (?, 'win')");
+        insert_library.bind(1, options.v3 ? 40 : 30).run();
+    }
+    
+    Statement insert_file(db,
+        "INSERT INTO bf_file (name, pid, is_hide, is_link, file_size, ctime, mtime, md5, tid, born, ttid) "
+        "VALUES (?, ?, 0, ?, ?, ?, ?, ?, 20, ?, 0)");
+    Statement insert_tag(db, options.v3 ?
+        "INSERT INTO bf_tag_v2 (id, name, pid, seq, icon, color, born) VALUES (?, ?, ?, 0, 0, 0, 1651940896)" :
+        "INSERT INTO bf_tag (id, name, color, born) VALUES (?, ?, 0, 1651940896)");
+    Statement insert_join(db, "INSERT INTO bf_tag_join_file (file_id, tag_id, born) VALUES (?, ?, 1651940896)");
+    Statement insert_note(db, "INSERT INTO bf_material_userdata (file_id, note, origin) VALUES (?, ?, ?)");
+    if (!insert_file || !insert_tag || !insert_join || !insert_note) {
+        return false;
+    }
+    
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    
+    // 标签字典：ID 1..tag_count
+    const size_t tag_count = std::max<size_t>(options.tag_count, 1);
+    std::vector<std::string> tag_names;
+    tag_names.reserve(tag_count);
+    for (size_t i = 0; i < tag_count; ++i) {
+        tag_names.push_back(make_tag_name(i));
+        insert_tag.bind(1, static_cast<int64_t>(i + 1)).bind(2, tag_names.back());
+        if (options.v3) {
+            insert_tag.bind(3, 0);
+        }
+        insert_tag.run();
+    }
+    int64_t next_tag_id = static_cast<int64_t>(tag_count) + 1;
+    
+    // 3.0 图库的作者标签挂在 Artist 父标签下
+    int64_t artist_parent_id = 0;
+    if (options.v3) {
+        artist_parent_id = next_tag_id++;
+        insert_tag.bind(1, artist_parent_id).bind(2, "Artist").bind(3, 0).run();
+    }
+    
+    // 作者：平均每位作者约 20 个作品，作者标签在第一次用到时创建
+    const size_t artist_count = std::max<size_t>(options.file_count / 40, 1);
+    std::vector<int64_t> artist_tag_ids(artist_count, 0);
+    
+    // 标签热度大致服从幂律：少数标签出现在大量作品上
+    auto pick_tag = [&]() {
+        double u = uniform(rng);
+        return static_cast<size_t>(tag_count * u * u * u);
+    };
+    
+    std::vector<size_t> illust_tags;
+    std::vector<int64_t> illust_files;
+    TagList bundle_tags;
+    std::string name;
+    Pid pid = 60000000;
+    
+    while (stats.files < options.file_count) {
+        // 无法提取PID的文件（相机照片、截图、设计源文件）
+        if (uniform(rng) < options.non_pixiv_ratio) {
+            switch (rng() % 3) {
+            case 0: name = "IMG_" + std::to_string(20200000 + rng() % 100000) + ".jpg"; break;
+            case 1: name = "Screenshot_" + std::to_string(rng() % 1000000) + ".png"; break;
+            default: name = "wallpaper_" + std::to_string(rng() % 1000000) + ".psd"; break;
+            }
+            insert_file.bind(1, name).bind(2, 1 + static_cast<int64_t>(rng() % kFolderCount)).bind(3, 0)
+                .bind(4, 100000 + static_cast<int64_t>(rng() % 5000000)).bind(5, kBornTime).bind(6, kBornTime)
+                .bind(7, make_md5(rng)).bind(8, kBornTime).run();
+            stats.files++;
+            continue;
+        }
+        
+        pid += 1 + rng() % 500;
+        stats.pids++;
+        
+        // 页数：七成单页，其余按几何分布延长，最多 60 页
+        size_t pages = 1;
+        if (uniform(rng) >= 0.7) {
+            pages = 2;
+            while (pages < 60 && uniform(rng) < 0.75) {
+                ++pages;
+            }
+        }
+        
+        double kind = uniform(rng);
+        const char* ext = kind < 0.55 ? "jpg" : kind < 0.95 ? "png" : kind < 0.98 ? "gif" : "zip";
+        bool link = uniform(rng) < 0.01;
+        bool plain = pages == 1 && rng() % 4 == 0;
+        int64_t folder = 1 + static_cast<int64_t>(rng() % kFolderCount);
+        
+        illust_files.clear();
+        for (size_t page = 0; page < pages && stats.files < options.file_count; ++page) {
+            name = std::to_string(pid);
+            if (!plain) {
+                name += "_p" + std::to_string(page);
+            }
+            name.append(".").append(ext);
+            if (link) {
+                name += ".lnk";
+            }
+            insert_file.bind(1, name).bind(2, folder).bind(3, link ? 1 : 0)
+                .bind(4, 100000 + static_cast<int64_t>(rng() % 5000000)).bind(5, kBornTime).bind(6, kBornTime)
+                .bind(7, make_md5(rng)).bind(8, kBornTime).run();
+            illust_files.push_back(sqlite3_last_insert_rowid(db));
+            stats.files++;
+        }
+        
+        size_t artist = rng() % artist_count;
+        std::string artist_name = "作者" + std::to_string(artist);
+        illust_tags.clear();
+        for (size_t i = 0; i < options.tags_per_file; ++i) {
+            illust_tags.push_back(pick_tag());
+        }
+        
+        // 已有标签：作者标签 + 普通标签，关联到作品的每个文件
+        if (uniform(rng) < options.tagged_ratio) {
+            int64_t& artist_tag_id = artist_tag_ids[artist];
+            if (artist_tag_id == 0) {
+                artist_tag_id = next_tag_id++;
+                insert_tag.bind(1, artist_tag_id);
+                if (options.v3) {
+                    insert_tag.bind(2, artist_name).bind(3, artist_parent_id);
+                } else {
+                    insert_tag.bind(2, "Artist:" + artist_name);
+                }
+                insert_tag.run();
+            }
+            // 同一作品可能抽到重复的标签，由表上的 on conflict ignore 去重
+            auto add_join = [&](int64_t file_id, int64_t tag_id) {
+                if (insert_join.bind(1, file_id).bind(2, tag_id).run() && sqlite3_changes(db) > 0) {
+                    stats.tag_joins++;
+                }
+            };
+            for (int64_t file_id : illust_files) {
+                add_join(file_id, artist_tag_id);
+                for (size_t tag : illust_tags) {
+                    add_join(file_id, static_cast<int64_t>(tag + 1));
+                }
+            }
+        }
+        
+        std::string origin = "https://www.pixiv.net/artworks/" + std::to_string(pid);
+        std::string note = make_note(pid, artist_name, 1000000 + static_cast<int64_t>(artist), rng);
+        
+        if (uniform(rng) < options.noted_ratio) {
+            for (int64_t file_id : illust_files) {
+                insert_note.bind(1, file_id).bind(2, note).bind(3, origin).run();
+                stats.notes++;
+            }
+        }
+        
+        // 抓取包覆盖全部作品（与已有数据重叠的部分用于检验跳过逻辑）
+        if (bundle) {
+            TagTable& table = TagTable::global();
+            bundle_tags.clear();
+            bundle_tags.push_back(table.intern("Artist:" + artist_name));
+            for (size_t tag : illust_tags) {
+                bundle_tags.push_back(table.intern(tag_names[tag]));
+            }
+            bundle->write_illust(pid, bundle_tags, note, origin);
+        }
+    }
+    
+    stats.tags = static_cast<size_t>(next_tag_id - 1);
+    
+    if (!execute(db, "COMMIT")) {
+        return false;
+    }
+    
+    if (bundle) {
+        stats.bundle_records = bundle->record_count();
+        if (!bundle->close()) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+} // namespace pixiv2billfish::tools
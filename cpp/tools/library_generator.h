@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace pixiv2billfish::tools {
+
+// 合成图库的规模与组成
+struct LibraryOptions {
+    size_t file_count = 10000;       // 文件数
+    bool v3 = false;                 // 生成 3.0 结构（bf_tag_v2、Artist 父标签）
+    size_t tag_count = 5000;         // 标签字典大小（不含作者标签）
+    size_t tags_per_file = 8;        // 每个已有标签的作品的标签数
+    double tagged_ratio = 0.3;       // 已有标签的作品比例
+    double noted_ratio = 0.1;        // 已有备注的作品比例
+    double non_pixiv_ratio = 0.05;   // 无法提取PID的文件比例
+    uint64_t seed = 42;
+    std::string bundle_path;         // 非空时同时写出覆盖全部PID的抓取包（同 --fetch 的输出）
+};
+
+// 生成结果
+struct LibraryStats {
+    size_t files = 0;
+    size_t pids = 0;
+    size_t tags = 0;
+    size_t tag_joins = 0;
+    size_t notes = 0;
+    size_t bundle_records = 0;
+};
+
+// 创建（覆盖）path 处的合成 Billfish 数据库。只包含本程序读写的表，结构与真实图库一致。
+// 文件名按真实收藏的分布生成：多页作品 <pid>_p<n>.<ext>（页数大多为 1，少数几十页）、
+// 单图 <pid>.<ext>、快捷方式 .lnk，以及少量无法提取PID的文件
+bool generate_library(const std::string& path, const LibraryOptions& options, LibraryStats& stats);
+
+} // namespace pixiv2billfish::tools